@@ -0,0 +1,87 @@
+#!/bin/sh
+# SPDX-License-Identifier: GPL-2.0-or-later
+#
+# Copyright(c) 2024 John Sanpe <sanpeqf@gmail.com>
+#
+# Build a User-Mode-Linux kernel with lksu built in and one without,
+# boot both with bench/syscall.c as init on a hostfs root and compare
+# the syscall costs. The kernel tree is wired up to build security/lksu
+# from this repository (idempotent).
+#
+# usage: run.sh <linux-source> [output-dir] [iterations]
+#
+
+set -e
+
+linux=$(cd "$1" && pwd)
+output=$(mkdir -p "${2:-bench-build}" && cd "${2:-bench-build}" && pwd)
+iters=${3:-20000}
+repo=$(cd "$(dirname "$0")/.." && pwd)
+cc=${CC:-cc}
+jobs=$(nproc 2>/dev/null || echo 1)
+
+if [ ! -e "$linux/security/lksu" ]; then
+    ln -s "$repo/src" "$linux/security/lksu"
+fi
+
+if ! grep -q 'security/lksu/Kconfig' "$linux/security/Kconfig"; then
+    echo 'source "security/lksu/Kconfig"' >> "$linux/security/Kconfig"
+fi
+
+if ! grep -q 'lksu/' "$linux/security/Makefile"; then
+    echo 'obj-$(CONFIG_LKSU) += lksu/' >> "$linux/security/Makefile"
+fi
+
+build_kernel() {
+    dir="$output/$1"
+    mkdir -p "$dir"
+
+    make -s -C "$linux" O="$dir" ARCH=um defconfig
+    "$linux/scripts/config" --file "$dir/.config" \
+        -e HOSTFS -e DEVTMPFS -e TMPFS -e SECURITY
+
+    if [ "$1" = lksu ]; then
+        "$linux/scripts/config" --file "$dir/.config" \
+            -e LKSU -e LKSU_HOOK_LSM
+    else
+        "$linux/scripts/config" --file "$dir/.config" -d LKSU
+    fi
+
+    make -s -C "$linux" O="$dir" ARCH=um olddefconfig
+    make -s -C "$linux" O="$dir" ARCH=um -j"$jobs" linux
+}
+
+boot_kernel() {
+    "$output/$1/linux" mem=512M rw \
+        rootfstype=hostfs rootflags="$output/rootfs" \
+        init=/init con=null con0=fd:0,fd:1 quiet -- "$iters" \
+        < /dev/null | grep '^kernel=' > "$output/$1.txt"
+}
+
+mkdir -p "$output/rootfs/proc" "$output/rootfs/dev"
+$cc -O2 -static -o "$output/rootfs/init" "$repo/bench/syscall.c"
+
+for kernel in baseline lksu; do
+    build_kernel $kernel
+    boot_kernel $kernel
+done
+
+awk '
+    function field(line, key,    n, i, kv) {
+        n = split(line, kv, " ")
+        for (i = 1; i <= n; i++)
+            if (index(kv[i], key "=") == 1)
+                return substr(kv[i], length(key) + 2)
+    }
+    FNR == NR {
+        base[field($0, "op")] = field($0, "ns")
+        next
+    }
+    {
+        op = field($0, "op")
+        ns = field($0, "ns")
+        printf "%-12s rules=%-7s %-12s %10.1f ns %+7.1f%%\n", op,
+               field($0, "rules"), field($0, "caller"), ns,
+               base[op] ? (ns - base[op]) * 100 / base[op] : 0
+    }
+' "$output/baseline.txt" "$output/lksu.txt" | tee "$output/results.txt"
@@ -0,0 +1,331 @@
+/* SPDX-License-Identifier: GPL-2.0-or-later */
+/*
+ * Copyright(c) 2024 John Sanpe <sanpeqf@gmail.com>
+ */
+
+/*
+ * Syscall overhead benchmark, run as init of a UML or QEMU guest.
+ *
+ * Builds a tmpfs test tree, then for every rule count loads synthetic
+ * hidden rules through prctl and times open, stat, statx, getdents64
+ * and a deep path walk from an unprivileged child, once plain and once
+ * with its uid whitelisted. On a kernel without lksu only the zero rule
+ * pass runs. Results are printed one measurement per line and the guest
+ * powers off when done.
+ */
+
+#define _GNU_SOURCE
+#include "../src/lksu.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <time.h>
+#include <unistd.h>
+#include <dirent.h>
+#include <sys/prctl.h>
+#include <sys/stat.h>
+#include <sys/mount.h>
+#include <sys/reboot.h>
+#include <sys/syscall.h>
+#include <sys/wait.h>
+
+#define BENCH_ROOT "/bench"
+#define BENCH_FILES 1000
+#define BENCH_DEPTH 16
+#define BENCH_DIR_FILES 64
+#define BENCH_UID 1000
+#define BENCH_TOKEN "00000000-0000-0000-0000-000000000000"
+
+static const unsigned int
+bench_rules[] = {
+    0, 1000, 10000, 100000,
+};
+
+static unsigned long bench_iters = 20000;
+static char deep_path[PATH_MAX];
+
+static int
+lksu_call(enum lksu_func func, struct lksu_message *msg)
+{
+    memcpy(msg->token, BENCH_TOKEN, LKSU_TOKEN_LEN);
+    msg->func = func;
+
+    return prctl(LKSU_SYSCALL_CTLKEY, msg, 0, 0, 0);
+}
+
+static double
+now_ns(void)
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1e9 + ts.tv_nsec;
+}
+
+static void
+file_name(char *buffer, size_t size, unsigned long index)
+{
+    snprintf(buffer, size, BENCH_ROOT "/tree/f%04lu", index % BENCH_FILES);
+}
+
+static int
+tree_create(void)
+{
+    char buffer[PATH_MAX];
+    unsigned int index;
+    size_t length;
+    int fd;
+
+    mkdir(BENCH_ROOT, 0755);
+    if (mount("tmpfs", BENCH_ROOT, "tmpfs", 0, "mode=0755"))
+        return -errno;
+
+    mkdir(BENCH_ROOT "/tree", 0755);
+    for (index = 0; index < BENCH_FILES; ++index) {
+        file_name(buffer, sizeof(buffer), index);
+        fd = open(buffer, O_CREAT | O_WRONLY, 0644);
+        if (fd < 0)
+            return -errno;
+        close(fd);
+    }
+
+    fd = open(BENCH_ROOT "/tree/hidden", O_CREAT | O_WRONLY, 0644);
+    if (fd < 0)
+        return -errno;
+    close(fd);
+
+    length = snprintf(deep_path, sizeof(deep_path), BENCH_ROOT "/deep");
+    mkdir(deep_path, 0755);
+    for (index = 0; index < BENCH_DEPTH; ++index) {
+        length += snprintf(deep_path + length, sizeof(deep_path) - length,
+                           "/d%02u", index);
+        mkdir(deep_path, 0755);
+    }
+
+    snprintf(deep_path + length, sizeof(deep_path) - length, "/leaf");
+    fd = open(deep_path, O_CREAT | O_WRONLY, 0644);
+    if (fd < 0)
+        return -errno;
+    close(fd);
+
+    return 0;
+}
+
+static int
+rules_load(unsigned int rules, int whitelist)
+{
+    struct lksu_message msg;
+    char buffer[PATH_MAX];
+    unsigned int index;
+
+    if (lksu_call(LKSU_FLUSH, &msg))
+        return -errno;
+
+    if (lksu_call(LKSU_ENABLE, &msg))
+        return -errno;
+
+    if (!rules)
+        return 0;
+
+    msg.args.g_hidden = BENCH_ROOT "/tree/hidden";
+    if (lksu_call(LKSU_GLOBAL_HIDDEN_ADD, &msg))
+        return -errno;
+
+    for (index = 1; index < rules; ++index) {
+        snprintf(buffer, sizeof(buffer), BENCH_ROOT "/rules/d%u/f%u",
+                 index / BENCH_DIR_FILES, index);
+        msg.args.g_hidden = buffer;
+        if (lksu_call(LKSU_GLOBAL_HIDDEN_ADD, &msg))
+            return -errno;
+    }
+
+    if (whitelist) {
+        msg.args.g_uid = BENCH_UID;
+        if (lksu_call(LKSU_GLOBAL_UID_ADD, &msg))
+            return -errno;
+    }
+
+    return 0;
+}
+
+static double
+bench_open(unsigned long iters)
+{
+    char buffer[PATH_MAX];
+    unsigned long count;
+    double start;
+    int fd;
+
+    start = now_ns();
+    for (count = 0; count < iters; ++count) {
+        file_name(buffer, sizeof(buffer), count);
+        fd = open(buffer, O_RDONLY);
+        if (fd >= 0)
+            close(fd);
+    }
+
+    return (now_ns() - start) / iters;
+}
+
+static double
+bench_stat(unsigned long iters)
+{
+    char buffer[PATH_MAX];
+    unsigned long count;
+    struct stat st;
+    double start;
+
+    start = now_ns();
+    for (count = 0; count < iters; ++count) {
+        file_name(buffer, sizeof(buffer), count);
+        stat(buffer, &st);
+    }
+
+    return (now_ns() - start) / iters;
+}
+
+static double
+bench_statx(unsigned long iters)
+{
+    char buffer[PATH_MAX];
+    unsigned long count;
+    struct statx stx;
+    double start;
+
+    start = now_ns();
+    for (count = 0; count < iters; ++count) {
+        file_name(buffer, sizeof(buffer), count);
+        statx(AT_FDCWD, buffer, 0, STATX_BASIC_STATS, &stx);
+    }
+
+    return (now_ns() - start) / iters;
+}
+
+static double
+bench_getdents(unsigned long iters)
+{
+    char buffer[32768];
+    unsigned long count;
+    double start;
+    long retval;
+    int fd;
+
+    iters = iters / 100 ?: 1;
+    start = now_ns();
+    for (count = 0; count < iters; ++count) {
+        fd = open(BENCH_ROOT "/tree", O_RDONLY | O_DIRECTORY);
+        if (fd < 0)
+            continue;
+        do
+            retval = syscall(SYS_getdents64, fd, buffer, sizeof(buffer));
+        while (retval > 0);
+        close(fd);
+    }
+
+    return (now_ns() - start) / iters;
+}
+
+static double
+bench_walk(unsigned long iters)
+{
+    unsigned long count;
+    struct stat st;
+    double start;
+
+    start = now_ns();
+    for (count = 0; count < iters; ++count)
+        stat(deep_path, &st);
+
+    return (now_ns() - start) / iters;
+}
+
+static const struct {
+    const char *name;
+    double (*func)(unsigned long iters);
+} bench_ops[] = {
+    { "open", bench_open },
+    { "stat", bench_stat },
+    { "statx", bench_statx },
+    { "getdents64", bench_getdents },
+    { "walk", bench_walk },
+};
+
+static void
+bench_pass(const char *kernel, unsigned int rules, int whitelist)
+{
+    unsigned int index;
+    pid_t pid;
+
+    pid = fork();
+    if (pid < 0)
+        return;
+
+    if (pid) {
+        waitpid(pid, NULL, 0);
+        return;
+    }
+
+    if (setuid(BENCH_UID))
+        _exit(1);
+
+    for (index = 0; index < sizeof(bench_ops) / sizeof(*bench_ops); ++index) {
+        bench_ops[index].func(bench_iters / 10 ?: 1);
+        printf("kernel=%s rules=%u caller=%s op=%s ns=%.1f\n",
+               kernel, rules, whitelist ? "whitelisted" : "plain",
+               bench_ops[index].name, bench_ops[index].func(bench_iters));
+    }
+
+    fflush(stdout);
+    _exit(0);
+}
+
+int
+main(int argc, char *argv[])
+{
+    struct lksu_message msg;
+    const char *kernel;
+    unsigned int index;
+    int whitelist, retval;
+
+    if (argc > 1)
+        bench_iters = strtoul(argv[1], NULL, 0) ?: bench_iters;
+
+    mount("proc", "/proc", "proc", 0, NULL);
+    mount("devtmpfs", "/dev", "devtmpfs", 0, NULL);
+    setvbuf(stdout, NULL, _IOLBF, 0);
+
+    retval = tree_create();
+    if (retval) {
+        fprintf(stderr, "failed to create tree: %s\n", strerror(-retval));
+        goto finish;
+    }
+
+    kernel = lksu_call(LKSU_ENABLE, &msg) ? "baseline" : "lksu";
+    for (index = 0; index < sizeof(bench_rules) / sizeof(*bench_rules); ++index) {
+        for (whitelist = 0; whitelist < 2; ++whitelist) {
+            if (strcmp(kernel, "lksu")) {
+                if (index || whitelist)
+                    continue;
+            } else {
+                retval = rules_load(bench_rules[index], whitelist);
+                if (retval) {
+                    fprintf(stderr, "failed to load %u rules: %s\n",
+                            bench_rules[index], strerror(-retval));
+                    continue;
+                }
+            }
+
+            bench_pass(kernel, bench_rules[index], whitelist);
+        }
+    }
+
+finish:
+    sync();
+    if (getpid() == 1)
+        reboot(RB_POWER_OFF);
+
+    return 0;
+}
@@ -0,0 +1,426 @@
+/* SPDX-License-Identifier: GPL-2.0-or-later */
+/*
+ * Copyright(c) 2024 John Sanpe <sanpeqf@gmail.com>
+ */
+
+#define MODULE_NAME "lksu-bench"
+#define pr_fmt(fmt) MODULE_NAME ": " fmt
+
+#include "lksu.h"
+#include "bench.h"
+#include "hidden.h"
+#include "tables.h"
+#include "token.h"
+
+#include <linux/module.h>
+#include <linux/debugfs.h>
+#include <linux/seq_file.h>
+#include <linux/ktime.h>
+#include <linux/sort.h>
+#include <linux/slab.h>
+#include <linux/cred.h>
+#include <linux/random.h>
+#include <linux/mutex.h>
+#include <linux/list.h>
+#include <linux/sched.h>
+#include <linux/printk.h>
+
+#define BENCH_RULES_MIN 10
+#define BENCH_RULES_MAX 100000
+#define BENCH_DIR_FILES 64
+#define BENCH_UID_BASE 100000
+#define BENCH_KEYS 256
+#define BENCH_KEYLEN 64
+#define BENCH_SAMPLES 1024
+#define BENCH_BATCH 64
+
+enum bench_prim {
+    BENCH_GFILE = 0,
+    BENCH_FILE,
+    BENCH_GDIRENT,
+    BENCH_GUID,
+    BENCH_TOKEN,
+    BENCH_UID_TABLE,
+    BENCH_PRIM_NR,
+};
+
+enum bench_case {
+    BENCH_HIT = 0,
+    BENCH_MISS,
+    BENCH_PREFIX,
+    BENCH_CASE_NR,
+};
+
+struct bench_result {
+    struct list_head list;
+    enum bench_prim prim;
+    enum bench_case type;
+    unsigned int rules;
+    size_t memory;
+    u64 p50, p90, p99, max;
+};
+
+struct bench_keys {
+    const void *key[BENCH_KEYS];
+    char name[BENCH_KEYS][BENCH_KEYLEN];
+    kuid_t kuid[BENCH_KEYS];
+};
+
+static const char *
+prim_names[BENCH_PRIM_NR] = {
+    [BENCH_GFILE] = "gfile_check",
+    [BENCH_FILE] = "file_check",
+    [BENCH_GDIRENT] = "gdirent_check",
+    [BENCH_GUID] = "guid_check",
+    [BENCH_TOKEN] = "token_verify",
+    [BENCH_UID_TABLE] = "uid-table",
+};
+
+static const char *
+case_names[BENCH_CASE_NR] = {
+    [BENCH_HIT] = "hit",
+    [BENCH_MISS] = "miss",
+    [BENCH_PREFIX] = "prefix",
+};
+
+static struct dentry *bench_root;
+static LIST_HEAD(bench_results);
+static DEFINE_MUTEX(bench_mutex);
+
+static __always_inline bool
+bench_call(enum bench_prim prim, const void *key)
+{
+    switch (prim) {
+        case BENCH_GFILE:
+            return lksu_table_gfile_check(key);
+
+        case BENCH_FILE:
+            return lksu_table_file_check(key);
+
+        case BENCH_GDIRENT:
+            return lksu_table_gdirent_check(key);
+
+        case BENCH_GUID:
+            return lksu_table_guid_check(*(const kuid_t *)key);
+
+        case BENCH_TOKEN:
+            return lksu_token_verify(key);
+
+        case BENCH_UID_TABLE:
+            return lksu_table_guid_check(current_uid());
+
+        default:
+            return false;
+    }
+}
+
+static void
+bench_token_name(char *buffer, unsigned int index)
+{
+    snprintf(buffer, BENCH_KEYLEN, "%08x-0000-4000-8000-%012x",
+             index, index);
+}
+
+static bool
+bench_keys_fill(struct bench_keys *keys, enum bench_prim prim,
+                enum bench_case type, unsigned int rules)
+{
+    unsigned int count, index;
+    char *name;
+
+    for (count = 0; count < BENCH_KEYS; ++count) {
+        index = get_random_u32() % rules;
+        name = keys->name[count];
+        keys->key[count] = name;
+
+        switch (prim) {
+            case BENCH_GFILE:
+            case BENCH_FILE:
+                if (type == BENCH_HIT)
+                    snprintf(name, BENCH_KEYLEN, "/bench/d%u/f%u",
+                             index / BENCH_DIR_FILES, index);
+                else if (type == BENCH_MISS)
+                    snprintf(name, BENCH_KEYLEN, "/bench/d%u/m%u",
+                             index / BENCH_DIR_FILES, index);
+                else
+                    snprintf(name, BENCH_KEYLEN, "/bench/d%u",
+                             index / BENCH_DIR_FILES);
+                break;
+
+            case BENCH_GDIRENT:
+                if (type == BENCH_HIT)
+                    snprintf(name, BENCH_KEYLEN, "/bench/d%u",
+                             index / BENCH_DIR_FILES);
+                else if (type == BENCH_MISS)
+                    snprintf(name, BENCH_KEYLEN, "/other/d%u",
+                             index / BENCH_DIR_FILES);
+                else
+                    strscpy(name, "/bench", BENCH_KEYLEN);
+                break;
+
+            case BENCH_GUID:
+                if (type == BENCH_PREFIX)
+                    return false;
+                keys->kuid[count] = KUIDT_INIT(BENCH_UID_BASE +
+                    index * 2 + (type == BENCH_MISS));
+                keys->key[count] = &keys->kuid[count];
+                break;
+
+            case BENCH_TOKEN:
+                if (type == BENCH_PREFIX)
+                    return false;
+                bench_token_name(name, type == BENCH_HIT ?
+                                 index : index + rules);
+                break;
+
+            case BENCH_UID_TABLE:
+                if (type != BENCH_HIT)
+                    return false;
+                break;
+
+            default:
+                return false;
+        }
+    }
+
+    return true;
+}
+
+static int
+bench_u64_cmp(const void *a, const void *b)
+{
+    u64 va = *(const u64 *)a;
+    u64 vb = *(const u64 *)b;
+
+    if (va == vb)
+        return 0;
+
+    return va < vb ? -1 : 1;
+}
+
+static void
+bench_measure(struct bench_result *result, const struct bench_keys *keys,
+              u64 *samples)
+{
+    unsigned int sample, count;
+    const void *key;
+    u64 start;
+    bool sink;
+
+    sink = false;
+    for (sample = 0; sample < BENCH_SAMPLES; ++sample) {
+        start = ktime_get_ns();
+        for (count = 0; count < BENCH_BATCH; ++count) {
+            key = keys->key[(sample * BENCH_BATCH + count) % BENCH_KEYS];
+            sink ^= bench_call(result->prim, key);
+        }
+        samples[sample] = ktime_get_ns() - start;
+        cond_resched();
+    }
+    OPTIMIZER_HIDE_VAR(sink);
+
+    sort(samples, BENCH_SAMPLES, sizeof(*samples), bench_u64_cmp, NULL);
+    result->p50 = div_u64(samples[BENCH_SAMPLES * 50 / 100], BENCH_BATCH);
+    result->p90 = div_u64(samples[BENCH_SAMPLES * 90 / 100], BENCH_BATCH);
+    result->p99 = div_u64(samples[BENCH_SAMPLES * 99 / 100], BENCH_BATCH);
+    result->max = div_u64(samples[BENCH_SAMPLES - 1], BENCH_BATCH);
+}
+
+static int
+bench_populate(unsigned int rules)
+{
+    char name[BENCH_KEYLEN];
+    unsigned int index;
+    int retval;
+
+    lksu_token_flush();
+    lksu_table_flush();
+
+    for (index = 0; index < rules; ++index) {
+        snprintf(name, sizeof(name), "/bench/d%u/f%u",
+                 index / BENCH_DIR_FILES, index);
+        retval = lksu_table_gfile_add(name);
+        if (retval)
+            return retval;
+
+        retval = lksu_table_guid_add(KUIDT_INIT(BENCH_UID_BASE + index * 2));
+        if (retval)
+            return retval;
+
+        bench_token_name(name, index);
+        retval = lksu_token_add(name);
+        if (retval)
+            return retval;
+
+        cond_resched();
+    }
+
+    return 0;
+}
+
+static int
+bench_run(unsigned int rules)
+{
+    struct bench_result *result;
+    enum bench_prim prim;
+    enum bench_case type;
+    struct bench_keys *keys;
+    size_t memory;
+    u64 *samples;
+    int retval;
+
+    keys = kmalloc(sizeof(*keys), GFP_KERNEL);
+    samples = kmalloc_array(BENCH_SAMPLES, sizeof(*samples), GFP_KERNEL);
+    if (unlikely(!keys || !samples)) {
+        retval = -ENOMEM;
+        goto finish;
+    }
+
+    retval = bench_populate(rules);
+    if (retval) {
+        pr_err("failed to populate %u rules: %d\n", rules, retval);
+        goto finish;
+    }
+
+    memory = lksu_table_memory();
+    for (prim = 0; prim < BENCH_PRIM_NR; ++prim) {
+        for (type = 0; type < BENCH_CASE_NR; ++type) {
+            if (!bench_keys_fill(keys, prim, type, rules))
+                continue;
+
+            result = kzalloc(sizeof(*result), GFP_KERNEL);
+            if (unlikely(!result)) {
+                retval = -ENOMEM;
+                goto finish;
+            }
+
+            result->prim = prim;
+            result->type = type;
+            result->rules = rules;
+            result->memory = memory;
+
+            bench_measure(result, keys, samples);
+            list_add_tail(&result->list, &bench_results);
+        }
+    }
+
+finish:
+    lksu_token_flush();
+    lksu_table_flush();
+    kfree(samples);
+    kfree(keys);
+    return retval;
+}
+
+static void
+bench_clear(void)
+{
+    struct bench_result *result, *tmp;
+
+    list_for_each_entry_safe(result, tmp, &bench_results, list) {
+        list_del(&result->list);
+        kfree(result);
+    }
+}
+
+static ssize_t
+run_write(struct file *file, const char __user *buf,
+          size_t count, loff_t *ppos)
+{
+    unsigned int rules;
+    int retval;
+
+    retval = kstrtouint_from_user(buf, count, 0, &rules);
+    if (retval)
+        return retval;
+
+    if (rules && (rules < BENCH_RULES_MIN || rules > BENCH_RULES_MAX))
+        return -ERANGE;
+
+    mutex_lock(&bench_mutex);
+    if (rules)
+        retval = bench_run(rules);
+    else
+        bench_clear();
+    mutex_unlock(&bench_mutex);
+
+    return retval ?: count;
+}
+
+static const struct file_operations
+run_fops = {
+    .owner = THIS_MODULE,
+    .write = run_write,
+    .llseek = noop_llseek,
+};
+
+static int
+results_show(struct seq_file *seq, void *val)
+{
+    struct bench_result *result;
+
+    seq_printf(seq, "%-16s%-8s%8s%10s%8s%8s%8s%8s\n", "primitive", "case",
+               "rules", "mem(KiB)", "p50", "p90", "p99", "max");
+
+    mutex_lock(&bench_mutex);
+    list_for_each_entry(result, &bench_results, list) {
+        seq_printf(seq, "%-16s%-8s%8u%10zu%8llu%8llu%8llu%8llu\n",
+                   prim_names[result->prim], case_names[result->type],
+                   result->rules, result->memory / 1024,
+                   result->p50, result->p90,
+                   result->p99, result->max);
+    }
+    mutex_unlock(&bench_mutex);
+
+    return 0;
+}
+DEFINE_SHOW_ATTRIBUTE(results);
+
+static __init int
+lksu_bench_init(void)
+{
+    int retval;
+
+    retval = lksu_token_init();
+    if (retval)
+        return retval;
+
+    retval = lksu_tables_init();
+    if (retval)
+        goto free_token;
+
+    retval = lksu_hidden_init();
+    if (retval)
+        goto free_tables;
+
+    bench_root = debugfs_create_dir(MODULE_NAME, NULL);
+    debugfs_create_file("run", 0200, bench_root, NULL, &run_fops);
+    debugfs_create_file("results", 0400, bench_root, NULL, &results_fops);
+    lksu_stress_init(bench_root);
+
+    return 0;
+
+free_tables:
+    lksu_tables_exit();
+free_token:
+    lksu_token_exit();
+    return retval;
+}
+
+static __exit void
+lksu_bench_exit(void)
+{
+    debugfs_remove_recursive(bench_root);
+    lksu_stress_exit();
+    bench_clear();
+    lksu_hidden_exit();
+    lksu_tables_exit();
+    lksu_token_exit();
+}
+
+module_init(lksu_bench_init);
+module_exit(lksu_bench_exit);
+
+MODULE_AUTHOR("John Sanpe <sanpeqf@gmail.com>");
+MODULE_DESCRIPTION("Linux Kernel SU microbenchmark");
+MODULE_LICENSE("GPL v2");
@@ -0,0 +1,18 @@
+/* SPDX-License-Identifier: GPL-2.0-or-later */
+/*
+ * Copyright(c) 2024 John Sanpe <sanpeqf@gmail.com>
+ */
+
+#ifndef _LKSU_BENCH_H_
+#define _LKSU_BENCH_H_
+
+#include <linux/module.h>
+#include <linux/debugfs.h>
+
+extern void
+lksu_stress_init(struct dentry *root);
+
+extern void
+lksu_stress_exit(void);
+
+#endif /* _LKSU_BENCH_H_ */
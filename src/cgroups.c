@@ -0,0 +1,212 @@
+/* SPDX-License-Identifier: GPL-2.0-or-later */
+/*
+ * Copyright(c) 2024 John Sanpe <sanpeqf@gmail.com>
+ */
+
+#define MODULE_NAME "lksu-cgroups"
+#define pr_fmt(fmt) MODULE_NAME ": " fmt
+
+#include "lksu.h"
+#include "cgroups.h"
+
+#include <linux/module.h>
+#include <linux/slab.h>
+#include <linux/cgroup.h>
+#include <linux/hashtable.h>
+#include <linux/mutex.h>
+#include <linux/percpu.h>
+#include <linux/rcupdate.h>
+#include <linux/version.h>
+#include <linux/printk.h>
+
+#define CGROUPS_HASH_BITS 6
+
+#if IS_ENABLED(CONFIG_CGROUPS) && LINUX_VERSION_CODE >= KERNEL_VERSION(5, 5, 0)
+# define CGROUPS_SUPPORTED 1
+#else
+# define CGROUPS_SUPPORTED 0
+#endif
+
+/*
+ * Whitelisted cgroup v2 ids, a cgroup is exempt when it or one of
+ * its ancestors is listed. The verdict of the last cgroup seen is
+ * cached per cpu and tagged with the rule generation, so a check
+ * from the same cgroup costs one compare until the rules change.
+ * Cgroup ids are never reused, a stale cache entry can not match.
+ */
+struct lksu_cgroup_table {
+    struct hlist_node hash;
+    u64 id;
+    struct rcu_head rcu;
+};
+
+struct cgroups_cache {
+    u64 id;
+    unsigned long generation;
+    bool allowed;
+};
+
+unsigned int lksu_cgroups_count __read_mostly;
+static unsigned long cgroups_generation = 1;
+static DEFINE_PER_CPU(struct cgroups_cache, cgroups_cache);
+static DEFINE_HASHTABLE(cgroups_hash, CGROUPS_HASH_BITS);
+static DEFINE_MUTEX(lksu_cgroup_mutex);
+
+static struct lksu_cgroup_table *
+cgroups_find(u64 id)
+{
+    struct lksu_cgroup_table *table;
+
+    lockdep_assert_held(&lksu_cgroup_mutex);
+    hash_for_each_possible(cgroups_hash, table, hash, id) {
+        if (table->id == id)
+            return table;
+    }
+
+    return NULL;
+}
+
+/* Published after the hash changed, checks then walk again. */
+static void
+cgroups_changed(void)
+{
+    lockdep_assert_held(&lksu_cgroup_mutex);
+    smp_store_release(&cgroups_generation, cgroups_generation + 1);
+}
+
+static void
+cgroups_release(struct lksu_cgroup_table *table)
+{
+    hash_del_rcu(&table->hash);
+    WRITE_ONCE(lksu_cgroups_count, lksu_cgroups_count - 1);
+    kfree_rcu(table, rcu);
+}
+
+#if CGROUPS_SUPPORTED
+static struct lksu_cgroup_table *
+cgroups_lookup(u64 id)
+{
+    struct lksu_cgroup_table *table;
+
+    hash_for_each_possible_rcu(cgroups_hash, table, hash, id) {
+        if (table->id == id)
+            return table;
+    }
+
+    return NULL;
+}
+
+static bool
+cgroups_walk(struct cgroup *cgrp)
+{
+    for (; cgrp; cgrp = cgroup_parent(cgrp)) {
+        if (cgroups_lookup(cgroup_id(cgrp)))
+            return true;
+    }
+
+    return false;
+}
+
+bool
+lksu_cgroup_check(void)
+{
+    struct cgroups_cache *cache;
+    unsigned long generation;
+    struct cgroup *cgrp;
+    bool allowed;
+    u64 id;
+
+    if (!lksu_cgroups_active())
+        return false;
+
+    rcu_read_lock();
+    generation = smp_load_acquire(&cgroups_generation);
+    cgrp = task_dfl_cgroup(current);
+    id = cgroup_id(cgrp);
+
+    cache = get_cpu_ptr(&cgroups_cache);
+    if (cache->id == id && cache->generation == generation) {
+        allowed = cache->allowed;
+    } else {
+        allowed = cgroups_walk(cgrp);
+        cache->id = id;
+        cache->generation = generation;
+        cache->allowed = allowed;
+    }
+    put_cpu_ptr(&cgroups_cache);
+    rcu_read_unlock();
+
+    return allowed;
+}
+#else
+bool
+lksu_cgroup_check(void)
+{
+    return false;
+}
+#endif
+
+int
+lksu_cgroup_add(u64 id)
+{
+    struct lksu_cgroup_table *table;
+
+    if (!CGROUPS_SUPPORTED)
+        return -EOPNOTSUPP;
+
+    if (!id)
+        return -EINVAL;
+
+    table = kmalloc(sizeof(*table), GFP_KERNEL);
+    if (unlikely(!table))
+        return -ENOMEM;
+
+    table->id = id;
+
+    mutex_lock(&lksu_cgroup_mutex);
+    if (cgroups_find(id)) {
+        mutex_unlock(&lksu_cgroup_mutex);
+        kfree(table);
+        return -EALREADY;
+    }
+
+    hash_add_rcu(cgroups_hash, &table->hash, id);
+    WRITE_ONCE(lksu_cgroups_count, lksu_cgroups_count + 1);
+    cgroups_changed();
+    mutex_unlock(&lksu_cgroup_mutex);
+
+    return 0;
+}
+
+int
+lksu_cgroup_remove(u64 id)
+{
+    struct lksu_cgroup_table *table;
+    int retval;
+
+    retval = -ENOENT;
+    mutex_lock(&lksu_cgroup_mutex);
+    table = cgroups_find(id);
+    if (table) {
+        cgroups_release(table);
+        cgroups_changed();
+        retval = 0;
+    }
+    mutex_unlock(&lksu_cgroup_mutex);
+
+    return retval;
+}
+
+void
+lksu_cgroups_flush(void)
+{
+    struct lksu_cgroup_table *table;
+    struct hlist_node *tmp;
+    unsigned int bkt;
+
+    mutex_lock(&lksu_cgroup_mutex);
+    hash_for_each_safe(cgroups_hash, bkt, tmp, table, hash)
+        cgroups_release(table);
+    cgroups_changed();
+    mutex_unlock(&lksu_cgroup_mutex);
+}
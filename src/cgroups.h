@@ -0,0 +1,32 @@
+/* SPDX-License-Identifier: GPL-2.0-or-later */
+/*
+ * Copyright(c) 2024 John Sanpe <sanpeqf@gmail.com>
+ */
+
+#ifndef _LKSU_CGROUPS_H_
+#define _LKSU_CGROUPS_H_
+
+#include <linux/module.h>
+#include <linux/types.h>
+
+extern unsigned int lksu_cgroups_count;
+
+static inline bool
+lksu_cgroups_active(void)
+{
+    return READ_ONCE(lksu_cgroups_count);
+}
+
+extern bool
+lksu_cgroup_check(void);
+
+extern int
+lksu_cgroup_add(u64 id);
+
+extern int
+lksu_cgroup_remove(u64 id);
+
+extern void
+lksu_cgroups_flush(void);
+
+#endif /* _LKSU_CGROUPS_H_ */
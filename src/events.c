@@ -0,0 +1,206 @@
+/* SPDX-License-Identifier: GPL-2.0-or-later */
+/*
+ * Copyright(c) 2024 John Sanpe <sanpeqf@gmail.com>
+ */
+
+#define MODULE_NAME "lksu-events"
+#define pr_fmt(fmt) MODULE_NAME ": " fmt
+
+#include "lksu.h"
+#include "ring.h"
+#include "events.h"
+
+#include <linux/module.h>
+#include <linux/mutex.h>
+#include <linux/wait.h>
+#include <linux/poll.h>
+#include <linux/cred.h>
+#include <linux/sched.h>
+#include <linux/timekeeping.h>
+#include <linux/uaccess.h>
+#include <linux/printk.h>
+
+#define EVENTS_SIZE (64 * 1024)
+
+/*
+ * Audit events always go to a per cpu ring, so denials and control
+ * operations never wait on the console. Readers are serialized by
+ * events_mutex and report drops as a lost record before the rest.
+ */
+static struct lksu_ring *events_ring __read_mostly;
+static DECLARE_WAIT_QUEUE_HEAD(events_wait);
+static DEFINE_MUTEX(events_mutex);
+static unsigned long events_reported;
+static bool events_dying;
+
+static void
+event_record(enum lksu_event_type type, unsigned int func,
+             int retval, const char *name)
+{
+    struct lksu_event event;
+    size_t length;
+
+    if (unlikely(!events_ring))
+        return;
+
+    length = name ? strnlen(name, PATH_MAX) : 0;
+    event.size = sizeof(event) + length;
+    event.type = type;
+    event.func = func;
+    event.retval = retval;
+    event.uid = from_kuid(&init_user_ns, current_uid());
+    event.pid = task_tgid_nr(current);
+    event.time = ktime_get_ns();
+
+    if (!lksu_ring_write(events_ring, &event, sizeof(event), name, length))
+        return;
+
+    if (wq_has_sleeper(&events_wait))
+        wake_up_interruptible(&events_wait);
+}
+
+void
+lksu_event_deny(enum lksu_trace_hook hook, const char *name)
+{
+    event_record(LKSU_EVENT_DENY, hook, -ENOENT, name);
+}
+
+void
+lksu_event_control(enum lksu_func func, int retval, const char *name)
+{
+    event_record(LKSU_EVENT_CONTROL, func, retval, name);
+}
+
+void
+lksu_event_auth(int retval)
+{
+    event_record(LKSU_EVENT_AUTH, 0, retval, NULL);
+}
+
+static bool
+events_pending(void)
+{
+    if (READ_ONCE(events_dying))
+        return true;
+
+    return !lksu_ring_empty(events_ring) ||
+           lksu_ring_dropped(events_ring) != READ_ONCE(events_reported);
+}
+
+static ssize_t
+events_lost(char __user *buffer, size_t count)
+{
+    struct lksu_event event;
+    unsigned long dropped;
+
+    lockdep_assert_held(&events_mutex);
+    dropped = lksu_ring_dropped(events_ring) - events_reported;
+    if (!dropped)
+        return 0;
+
+    /* The drop stays pending, reading nothing would spin. */
+    if (count < sizeof(event))
+        return -EINVAL;
+
+    memset(&event, 0, sizeof(event));
+    event.size = sizeof(event);
+    event.type = LKSU_EVENT_LOST;
+    event.retval = min_t(unsigned long, dropped, S32_MAX);
+    event.time = ktime_get_ns();
+
+    if (copy_to_user(buffer, &event, sizeof(event)))
+        return -EFAULT;
+
+    WRITE_ONCE(events_reported, events_reported + event.retval);
+
+    return sizeof(event);
+}
+
+static ssize_t
+events_read(struct file *file, char __user *buffer,
+            size_t count, loff_t *ppos)
+{
+    ssize_t copied, retval;
+
+    for (;;) {
+        if (mutex_lock_interruptible(&events_mutex))
+            return -ERESTARTSYS;
+
+        copied = events_lost(buffer, count);
+        if (copied >= 0) {
+            retval = lksu_ring_read(events_ring, buffer + copied, count - copied);
+            if (retval >= 0)
+                copied += retval;
+            else if (!copied)
+                copied = retval;
+        }
+
+        mutex_unlock(&events_mutex);
+
+        if (copied)
+            break;
+
+        if (READ_ONCE(events_dying))
+            return 0;
+
+        if (file->f_flags & O_NONBLOCK)
+            return -EAGAIN;
+
+        retval = wait_event_interruptible(events_wait, events_pending());
+        if (retval)
+            return retval;
+    }
+
+    if (copied > 0)
+        *ppos += copied;
+
+    return copied;
+}
+
+static __poll_t
+events_poll(struct file *file, poll_table *wait)
+{
+    poll_wait(file, &events_wait, wait);
+
+    return events_pending() ? EPOLLIN | EPOLLRDNORM : 0;
+}
+
+const struct proc_ops
+lksu_events_ops = {
+    .proc_read = events_read,
+    .proc_poll = events_poll,
+    .proc_lseek = noop_llseek,
+};
+
+int __init
+lksu_events_init(void)
+{
+    events_ring = lksu_ring_alloc(EVENTS_SIZE);
+    if (!events_ring)
+        return -ENOMEM;
+
+    return 0;
+}
+
+/* Wakes blocked readers, the procfs entry can not go away under them. */
+void
+lksu_events_shutdown(void)
+{
+    WRITE_ONCE(events_dying, true);
+    wake_up_all(&events_wait);
+}
+
+void
+lksu_events_exit(void)
+{
+    struct lksu_ring *ring;
+
+    ring = events_ring;
+    WRITE_ONCE(events_ring, NULL);
+    if (!ring)
+        return;
+
+    if (lksu_ring_dropped(ring))
+        pr_notice("%lu events dropped\n", lksu_ring_dropped(ring));
+    lksu_ring_free(ring);
+}
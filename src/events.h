@@ -0,0 +1,34 @@
+/* SPDX-License-Identifier: GPL-2.0-or-later */
+/*
+ * Copyright(c) 2024 John Sanpe <sanpeqf@gmail.com>
+ */
+
+#ifndef _LKSU_EVENTS_H_
+#define _LKSU_EVENTS_H_
+
+#include <linux/module.h>
+#include <linux/types.h>
+#include <linux/proc_fs.h>
+#include "lksu.h"
+
+extern const struct proc_ops lksu_events_ops;
+
+extern void
+lksu_event_deny(enum lksu_trace_hook hook, const char *name);
+
+extern void
+lksu_event_control(enum lksu_func func, int retval, const char *name);
+
+extern void
+lksu_event_auth(int retval);
+
+extern int __init
+lksu_events_init(void);
+
+extern void
+lksu_events_shutdown(void);
+
+extern void
+lksu_events_exit(void);
+
+#endif /* _LKSU_EVENTS_H_ */
@@ -0,0 +1,337 @@
+/* SPDX-License-Identifier: GPL-2.0-or-later */
+/*
+ * Copyright(c) 2024 John Sanpe <sanpeqf@gmail.com>
+ */
+
+#define MODULE_NAME "lksu-exes"
+#define pr_fmt(fmt) MODULE_NAME ": " fmt
+
+#include "lksu.h"
+#include "exes.h"
+
+#include <linux/module.h>
+#include <linux/fs.h>
+#include <linux/namei.h>
+#include <linux/slab.h>
+#include <linux/hashtable.h>
+#include <linux/mutex.h>
+#include <linux/spinlock.h>
+#include <linux/rcupdate.h>
+#include <linux/printk.h>
+
+#define EXES_HASH_BITS 4
+#define EXES_TASK_HASH_BITS 6
+
+/*
+ * Whitelisted executables, identified by the device and inode number
+ * of the binary. They are only compared when a task commits an exec,
+ * the verdict then sticks to the task and its children until the next
+ * exec, so checking a task is one lookup keyed by its pointer. Tasks
+ * are dropped from task_free, which may run from an rcu callback, so
+ * the task lock disables interrupts.
+ */
+struct lksu_exe_table {
+    struct hlist_node hash;
+    dev_t dev;
+    unsigned long ino;
+};
+
+struct lksu_exe_task {
+    struct hlist_node hash;
+    const struct task_struct *task;
+    dev_t dev;
+    unsigned long ino;
+    struct rcu_head rcu;
+};
+
+unsigned int lksu_exes_marked __read_mostly;
+static unsigned int exes_count __read_mostly;
+static DEFINE_HASHTABLE(exe_hash, EXES_HASH_BITS);
+static DEFINE_HASHTABLE(exe_task_hash, EXES_TASK_HASH_BITS);
+static DEFINE_MUTEX(exe_mutex);
+static DEFINE_SPINLOCK(exe_task_lock);
+
+static inline unsigned long
+exe_key(dev_t dev, unsigned long ino)
+{
+    return ino ^ ((unsigned long)dev << 20);
+}
+
+static struct lksu_exe_table *
+exe_find(dev_t dev, unsigned long ino)
+{
+    struct lksu_exe_table *table;
+
+    hash_for_each_possible(exe_hash, table, hash, exe_key(dev, ino)) {
+        if (table->dev == dev && table->ino == ino)
+            return table;
+    }
+
+    return NULL;
+}
+
+static struct lksu_exe_task *
+exe_task_lookup(const struct task_struct *task)
+{
+    struct lksu_exe_task *entry;
+
+    hash_for_each_possible_rcu(exe_task_hash, entry, hash, (unsigned long)task) {
+        if (entry->task == task)
+            return entry;
+    }
+
+    return NULL;
+}
+
+static void
+exe_task_release(struct lksu_exe_task *entry)
+{
+    hash_del_rcu(&entry->hash);
+    WRITE_ONCE(lksu_exes_marked, lksu_exes_marked - 1);
+    kfree_rcu(entry, rcu);
+}
+
+static void
+exe_task_mark(struct task_struct *task, dev_t dev, unsigned long ino)
+{
+    struct lksu_exe_task *entry;
+    unsigned long flags;
+
+    entry = kmalloc(sizeof(*entry), GFP_KERNEL);
+    if (unlikely(!entry)) {
+        pr_warn_ratelimited("failed to whitelist task %d\n", task_pid_nr(task));
+        return;
+    }
+
+    entry->task = task;
+    entry->dev = dev;
+    entry->ino = ino;
+
+    spin_lock_irqsave(&exe_task_lock, flags);
+    if (exe_task_lookup(task)) {
+        spin_unlock_irqrestore(&exe_task_lock, flags);
+        kfree(entry);
+        return;
+    }
+
+    hash_add_rcu(exe_task_hash, &entry->hash, (unsigned long)task);
+    WRITE_ONCE(lksu_exes_marked, lksu_exes_marked + 1);
+    spin_unlock_irqrestore(&exe_task_lock, flags);
+}
+
+static void
+exe_task_unmark(const struct task_struct *task)
+{
+    struct lksu_exe_task *entry;
+    unsigned long flags;
+
+    spin_lock_irqsave(&exe_task_lock, flags);
+    entry = exe_task_lookup(task);
+    if (entry)
+        exe_task_release(entry);
+    spin_unlock_irqrestore(&exe_task_lock, flags);
+}
+
+bool
+lksu_exe_check(void)
+{
+    bool allowed;
+
+    if (!lksu_exes_active())
+        return false;
+
+    rcu_read_lock();
+    allowed = !!exe_task_lookup(current);
+    rcu_read_unlock();
+
+    return allowed;
+}
+
+/*
+ * The exec replaced the image, whatever the parent ran is forgotten.
+ * Marking happens under exe_mutex so a concurrent remove can not miss
+ * a task that is being let in.
+ */
+void
+lksu_exe_exec(const struct linux_binprm *bprm)
+{
+    struct inode *inode;
+    unsigned long ino;
+    dev_t dev;
+
+    if (!READ_ONCE(exes_count)) {
+        if (lksu_exes_active())
+            exe_task_unmark(current);
+        return;
+    }
+
+    inode = file_inode(bprm->file);
+    dev = inode->i_sb->s_dev;
+    ino = inode->i_ino;
+
+    mutex_lock(&exe_mutex);
+    if (exe_find(dev, ino))
+        exe_task_mark(current, dev, ino);
+    else if (lksu_exes_active())
+        exe_task_unmark(current);
+    mutex_unlock(&exe_mutex);
+}
+
+void
+lksu_exe_task_alloc(struct task_struct *task)
+{
+    struct lksu_exe_task *entry;
+    unsigned long ino;
+    dev_t dev;
+
+    if (!lksu_exes_active())
+        return;
+
+    mutex_lock(&exe_mutex);
+    rcu_read_lock();
+    entry = exe_task_lookup(current);
+    if (entry) {
+        dev = entry->dev;
+        ino = entry->ino;
+    }
+    rcu_read_unlock();
+
+    if (entry)
+        exe_task_mark(task, dev, ino);
+    mutex_unlock(&exe_mutex);
+}
+
+/* The task is only compared, never dereferenced. */
+void
+lksu_exe_task_free(struct task_struct *task)
+{
+    if (!lksu_exes_active())
+        return;
+
+    exe_task_unmark(task);
+}
+
+static int
+exe_resolve(const char *name, dev_t *dev, unsigned long *ino)
+{
+    struct inode *inode;
+    struct path path;
+    int retval;
+
+    retval = kern_path(name, LOOKUP_FOLLOW, &path);
+    if (retval)
+        return retval;
+
+    inode = d_backing_inode(path.dentry);
+    if (!S_ISREG(inode->i_mode)) {
+        path_put(&path);
+        return -EINVAL;
+    }
+
+    *dev = inode->i_sb->s_dev;
+    *ino = inode->i_ino;
+    path_put(&path);
+
+    return 0;
+}
+
+int
+lksu_exe_add(const char *name)
+{
+    struct lksu_exe_table *table;
+    unsigned long ino;
+    dev_t dev;
+    int retval;
+
+    retval = exe_resolve(name, &dev, &ino);
+    if (retval)
+        return retval;
+
+    table = kmalloc(sizeof(*table), GFP_KERNEL);
+    if (unlikely(!table))
+        return -ENOMEM;
+
+    table->dev = dev;
+    table->ino = ino;
+
+    mutex_lock(&exe_mutex);
+    if (exe_find(dev, ino)) {
+        mutex_unlock(&exe_mutex);
+        kfree(table);
+        return -EALREADY;
+    }
+
+    hash_add(exe_hash, &table->hash, exe_key(dev, ino));
+    WRITE_ONCE(exes_count, exes_count + 1);
+    mutex_unlock(&exe_mutex);
+
+    return 0;
+}
+
+/* Tasks that were let in by the removed executable lose it right away. */
+static void
+exe_revoke(dev_t dev, unsigned long ino)
+{
+    struct lksu_exe_task *entry;
+    struct hlist_node *tmp;
+    unsigned long flags;
+    unsigned int bkt;
+
+    spin_lock_irqsave(&exe_task_lock, flags);
+    hash_for_each_safe(exe_task_hash, bkt, tmp, entry, hash) {
+        if (entry->dev == dev && entry->ino == ino)
+            exe_task_release(entry);
+    }
+    spin_unlock_irqrestore(&exe_task_lock, flags);
+}
+
+int
+lksu_exe_remove(const char *name)
+{
+    struct lksu_exe_table *table;
+    unsigned long ino;
+    dev_t dev;
+    int retval;
+
+    retval = exe_resolve(name, &dev, &ino);
+    if (retval)
+        return retval;
+
+    mutex_lock(&exe_mutex);
+    table = exe_find(dev, ino);
+    if (!table) {
+        mutex_unlock(&exe_mutex);
+        return -ENOENT;
+    }
+
+    hash_del(&table->hash);
+    WRITE_ONCE(exes_count, exes_count - 1);
+    exe_revoke(dev, ino);
+    mutex_unlock(&exe_mutex);
+    kfree(table);
+
+    return 0;
+}
+
+void
+lksu_exes_flush(void)
+{
+    struct lksu_exe_table *table;
+    struct lksu_exe_task *entry;
+    struct hlist_node *tmp;
+    unsigned long flags;
+    unsigned int bkt;
+
+    mutex_lock(&exe_mutex);
+    hash_for_each_safe(exe_hash, bkt, tmp, table, hash) {
+        hash_del(&table->hash);
+        kfree(table);
+    }
+    WRITE_ONCE(exes_count, 0);
+
+    spin_lock_irqsave(&exe_task_lock, flags);
+    hash_for_each_safe(exe_task_hash, bkt, tmp, entry, hash)
+        exe_task_release(entry);
+    spin_unlock_irqrestore(&exe_task_lock, flags);
+    mutex_unlock(&exe_mutex);
+}
@@ -0,0 +1,43 @@
+/* SPDX-License-Identifier: GPL-2.0-or-later */
+/*
+ * Copyright(c) 2024 John Sanpe <sanpeqf@gmail.com>
+ */
+
+#ifndef _LKSU_EXES_H_
+#define _LKSU_EXES_H_
+
+#include <linux/module.h>
+#include <linux/types.h>
+#include <linux/sched.h>
+#include <linux/binfmts.h>
+
+extern unsigned int lksu_exes_marked;
+
+static inline bool
+lksu_exes_active(void)
+{
+    return READ_ONCE(lksu_exes_marked);
+}
+
+extern bool
+lksu_exe_check(void);
+
+extern void
+lksu_exe_exec(const struct linux_binprm *bprm);
+
+extern void
+lksu_exe_task_alloc(struct task_struct *task);
+
+extern void
+lksu_exe_task_free(struct task_struct *task);
+
+extern int
+lksu_exe_add(const char *name);
+
+extern int
+lksu_exe_remove(const char *name);
+
+extern void
+lksu_exes_flush(void);
+
+#endif /* _LKSU_EXES_H_ */
@@ -0,0 +1,430 @@
+/* SPDX-License-Identifier: GPL-2.0-or-later */
+/*
+ * Copyright(c) 2024 John Sanpe <sanpeqf@gmail.com>
+ */
+
+/*
+ * Host program turning a static rules file into perfect hash tables
+ * for tables.c. The rules file has one rule per line:
+ *
+ *   /path      file hidden from everyone, its directory included
+ *   uid N      uid on the global whitelist
+ *
+ * usage: gen-static [rules]
+ */
+
+#include "phash.h"
+
+#include <errno.h>
+#include <limits.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define GEN_SEEDS 1000
+#define GEN_TRIES (1U << 22)
+
+struct gen_key {
+    char *data;
+    unsigned int length;
+    unsigned long value;
+    unsigned long long hash;
+};
+
+struct gen_table {
+    const char *name;
+    struct gen_key *keys;
+    unsigned int count;
+    unsigned int size;
+
+    unsigned long long seed;
+    unsigned int nr_bucket;
+    unsigned int nr_slot;
+    unsigned int (*disp)[2];
+    int *slot;
+};
+
+struct gen_bucket {
+    unsigned int index;
+    unsigned int count;
+    unsigned int *keys;
+};
+
+static struct gen_table files = { .name = "file" };
+static struct gen_table dirs = { .name = "dir" };
+static struct gen_table uids = { .name = "uid" };
+
+static void *
+gen_alloc(size_t size)
+{
+    void *block;
+
+    block = calloc(1, size ? size : 1);
+    if (!block) {
+        fprintf(stderr, "gen-static: out of memory\n");
+        exit(1);
+    }
+
+    return block;
+}
+
+static struct gen_key *
+gen_add(struct gen_table *table, const void *data, unsigned int length)
+{
+    struct gen_key *key;
+
+    if (table->count == table->size) {
+        table->size = table->size * 2 + 64;
+        table->keys = realloc(table->keys, table->size * sizeof(*table->keys));
+        if (!table->keys) {
+            fprintf(stderr, "gen-static: out of memory\n");
+            exit(1);
+        }
+    }
+
+    key = &table->keys[table->count++];
+    key->data = gen_alloc(length + 1);
+    memcpy(key->data, data, length);
+    key->length = length;
+
+    return key;
+}
+
+static int
+gen_key_cmp(const void *a, const void *b)
+{
+    const struct gen_key *ka = a, *kb = b;
+
+    if (ka->length != kb->length)
+        return ka->length < kb->length ? -1 : 1;
+
+    return memcmp(ka->data, kb->data, ka->length);
+}
+
+static void
+gen_unique(struct gen_table *table)
+{
+    unsigned int index, count;
+
+    if (!table->count)
+        return;
+
+    qsort(table->keys, table->count, sizeof(*table->keys), gen_key_cmp);
+    for (index = count = 1; index < table->count; ++index) {
+        if (gen_key_cmp(&table->keys[count - 1], &table->keys[index]))
+            table->keys[count++] = table->keys[index];
+        else
+            free(table->keys[index].data);
+    }
+
+    table->count = count;
+}
+
+static unsigned int
+gen_pow2(unsigned int value)
+{
+    unsigned int result;
+
+    for (result = 1; result < value; result <<= 1)
+        ;
+
+    return result;
+}
+
+static int
+gen_bucket_cmp(const void *a, const void *b)
+{
+    const struct gen_bucket *ba = a, *bb = b;
+
+    if (ba->count != bb->count)
+        return ba->count < bb->count ? 1 : -1;
+
+    return ba->index < bb->index ? -1 : ba->index > bb->index;
+}
+
+static unsigned long long
+gen_seed(unsigned int round)
+{
+    unsigned long long value;
+
+    value = (round + 1) * LKSU_PHASH_MULT;
+    value ^= value >> 30;
+    value *= 0xbf58476d1ce4e5b9ULL;
+    value ^= value >> 27;
+
+    return value;
+}
+
+static int
+gen_place(struct gen_table *table, struct gen_bucket *bucket, unsigned int *places)
+{
+    unsigned int d0, d1, index, other;
+    unsigned long tries;
+    unsigned int disp[2];
+
+    tries = 0;
+    for (d0 = 0; d0 < table->nr_slot; ++d0) {
+        for (d1 = 0; d1 < table->nr_slot; ++d1) {
+            if (++tries > GEN_TRIES)
+                return -1;
+
+            disp[0] = d0;
+            disp[1] = d1;
+
+            for (index = 0; index < bucket->count; ++index) {
+                places[index] = lksu_phash_place(table->keys[bucket->keys[index]].hash,
+                                                 disp, table->nr_slot - 1);
+                if (table->slot[places[index]] >= 0)
+                    break;
+                for (other = 0; other < index; ++other) {
+                    if (places[other] == places[index])
+                        break;
+                }
+                if (other < index)
+                    break;
+            }
+
+            if (index == bucket->count) {
+                table->disp[bucket->index][0] = d0;
+                table->disp[bucket->index][1] = d1;
+                for (index = 0; index < bucket->count; ++index)
+                    table->slot[places[index]] = bucket->keys[index];
+                return 0;
+            }
+        }
+    }
+
+    return -1;
+}
+
+static int
+gen_round(struct gen_table *table, struct gen_bucket *buckets,
+          unsigned int *order, unsigned int *places)
+{
+    unsigned int index, bucket, start;
+    struct gen_key *key;
+
+    for (index = 0; index < table->nr_slot; ++index)
+        table->slot[index] = -1;
+
+    for (index = 0; index < table->nr_bucket; ++index) {
+        buckets[index].index = index;
+        buckets[index].count = 0;
+        table->disp[index][0] = 0;
+        table->disp[index][1] = 0;
+    }
+
+    for (index = 0; index < table->count; ++index) {
+        key = &table->keys[index];
+        key->hash = lksu_phash_hash(table->seed, key->data, key->length);
+        buckets[key->hash & (table->nr_bucket - 1)].count++;
+    }
+
+    /* Counting sort of the keys by bucket into one shared array. */
+    for (index = start = 0; index < table->nr_bucket; ++index) {
+        buckets[index].keys = order + start;
+        start += buckets[index].count;
+        buckets[index].count = 0;
+    }
+
+    for (index = 0; index < table->count; ++index) {
+        bucket = table->keys[index].hash & (table->nr_bucket - 1);
+        buckets[bucket].keys[buckets[bucket].count++] = index;
+    }
+
+    qsort(buckets, table->nr_bucket, sizeof(*buckets), gen_bucket_cmp);
+
+    for (index = 0; index < table->nr_bucket; ++index) {
+        if (!buckets[index].count)
+            break;
+        if (gen_place(table, &buckets[index], places))
+            return -1;
+    }
+
+    return 0;
+}
+
+static void
+gen_build(struct gen_table *table)
+{
+    struct gen_bucket *buckets;
+    unsigned int *order, *places;
+    unsigned int round;
+
+    gen_unique(table);
+    table->nr_bucket = gen_pow2((table->count + 3) / 4);
+    table->nr_slot = gen_pow2(table->count + table->count / 4);
+    table->disp = gen_alloc(table->nr_bucket * sizeof(*table->disp));
+    table->slot = gen_alloc(table->nr_slot * sizeof(*table->slot));
+    buckets = gen_alloc(table->nr_bucket * sizeof(*buckets));
+    order = gen_alloc(table->count * sizeof(*order));
+    places = gen_alloc(table->count * sizeof(*places));
+
+    for (round = 0; round < GEN_SEEDS; ++round) {
+        table->seed = gen_seed(round);
+        if (!gen_round(table, buckets, order, places))
+            break;
+    }
+
+    if (round == GEN_SEEDS) {
+        fprintf(stderr, "gen-static: no perfect hash for %u %ss\n",
+                table->count, table->name);
+        exit(1);
+    }
+
+    free(buckets);
+    free(order);
+    free(places);
+}
+
+static void
+gen_string(const char *data, unsigned int length)
+{
+    unsigned int index;
+
+    putchar('"');
+    for (index = 0; index < length; ++index) {
+        if (data[index] == '"' || data[index] == '\\')
+            printf("\\%c", data[index]);
+        else if (data[index] < ' ' || data[index] > '~')
+            printf("\\%03o", (unsigned char)data[index]);
+        else
+            putchar(data[index]);
+    }
+    putchar('"');
+}
+
+static void
+gen_emit(struct gen_table *table)
+{
+    struct gen_key *key;
+    unsigned int index;
+    int slot;
+
+    printf("static const unsigned int\nstatic_%s_disp[][2] = {\n", table->name);
+    for (index = 0; index < table->nr_bucket; ++index)
+        printf("    { %u, %u },\n", table->disp[index][0], table->disp[index][1]);
+    printf("};\n\n");
+
+    printf("static const struct lksu_phash\nstatic_%s = {\n", table->name);
+    printf("    .seed = 0x%016llxULL,\n", table->seed);
+    printf("    .bucket_mask = %u,\n", table->nr_bucket - 1);
+    printf("    .slot_mask = %u,\n", table->nr_slot - 1);
+    printf("    .disp = static_%s_disp,\n", table->name);
+    printf("};\n\n");
+
+    if (table == &uids)
+        printf("static const unsigned int\nstatic_%s_slot[] = {\n", table->name);
+    else
+        printf("static const struct lksu_phash_name\nstatic_%s_slot[] = {\n", table->name);
+
+    for (index = 0; index < table->nr_slot; ++index) {
+        slot = table->slot[index];
+        if (table == &uids) {
+            if (slot < 0)
+                printf("    0xffffffff,\n");
+            else
+                printf("    %luU,\n", table->keys[slot].value);
+            continue;
+        }
+
+        if (slot < 0) {
+            printf("    { NULL, 0 },\n");
+            continue;
+        }
+
+        key = &table->keys[slot];
+        printf("    { ");
+        gen_string(key->data, key->length);
+        printf(", %u },\n", key->length);
+    }
+    printf("};\n\n");
+}
+
+static int
+gen_parse(const char *path, FILE *file)
+{
+    char line[PATH_MAX + 64], *end;
+    unsigned char bytes[4];
+    unsigned long value;
+    unsigned int lineno;
+    size_t length;
+    char *base;
+
+    lineno = 0;
+    while (fgets(line, sizeof(line), file)) {
+        lineno++;
+        line[strcspn(line, "\r\n")] = '\0';
+
+        if (!*line || *line == '#')
+            continue;
+
+        if (!strncmp(line, "uid ", 4)) {
+            errno = 0;
+            value = strtoul(line + 4, &end, 10);
+            if (errno || end == line + 4 || *end || value >= 0xffffffffUL)
+                goto invalid;
+
+            /* Uids hash as little endian bytes whatever the host is. */
+            bytes[0] = value;
+            bytes[1] = value >> 8;
+            bytes[2] = value >> 16;
+            bytes[3] = value >> 24;
+            gen_add(&uids, bytes, sizeof(bytes))->value = value;
+            continue;
+        }
+
+        length = strlen(line);
+        if (*line != '/' || length >= PATH_MAX)
+            goto invalid;
+
+        base = strrchr(line, '/');
+        gen_add(&files, line, length);
+        gen_add(&dirs, line, base - line);
+        continue;
+
+    invalid:
+        fprintf(stderr, "%s:%u: invalid rule '%s'\n", path, lineno, line);
+        return -1;
+    }
+
+    return 0;
+}
+
+int
+main(int argc, char *argv[])
+{
+    const char *path;
+    FILE *file;
+
+    path = argc > 1 && *argv[1] ? argv[1] : NULL;
+    if (path) {
+        file = fopen(path, "r");
+        if (!file) {
+            perror(path);
+            return 1;
+        }
+
+        if (gen_parse(path, file)) {
+            fclose(file);
+            return 1;
+        }
+
+        fclose(file);
+    }
+
+    gen_build(&files);
+    gen_build(&dirs);
+    gen_build(&uids);
+
+    printf("/* Generated by gen-static from %s, do not edit. */\n\n",
+           path ? path : "no rules");
+    printf("#define LKSU_STATIC_FILES %u\n", files.count);
+    printf("#define LKSU_STATIC_UIDS %u\n\n", uids.count);
+
+    gen_emit(&files);
+    gen_emit(&dirs);
+    gen_emit(&uids);
+
+    return 0;
+}
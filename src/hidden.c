@@ -9,52 +9,202 @@
 #include "lksu.h"
 #include "hidden.h"
 #include "tables.h"
+#include "trace.h"
+#include "pids.h"
+#include "marks.h"
+#include "events.h"
 #include "rbtree.h"
 
 #include <linux/module.h>
 #include <linux/fs.h>
 #include <linux/slab.h>
+#include <linux/ctype.h>
+#include <linux/magic.h>
+#include <linux/proc_fs.h>
+#include <linux/pid_namespace.h>
 #include <linux/version.h>
 #include <linux/printk.h>
 #include <linux/errname.h>
+#include <linux/srcu.h>
+#include <linux/seqlock.h>
+#include <linux/fs_struct.h>
+#include <linux/nsproxy.h>
+#include <linux/sched/task.h>
+#include <linux/workqueue.h>
 
+/*
+ * Directories with hidden entries get a copy of their fops pointing
+ * at iter_file and release_dirent, which outlive the open hook. A
+ * caller may have loaded the copy long before entering it, so every
+ * wrapped file pins the module until release_dirent drops it. The
+ * put happens inside dirent_srcu, the unload waits for it to leave.
+ */
 static struct kmem_cache *filldir_cache __read_mostly;
 static struct rb_root hidden_dirent = RB_ROOT;
 static DEFINE_SPINLOCK(dirent_lock);
+DEFINE_STATIC_SRCU(dirent_srcu);
 
 struct iter_context {
     struct dir_context ctx;
     struct dir_context *octx;
+    struct pid_namespace *pid_ns;
+    const struct super_block *sb;
     const char *path;
     char *name;
 };
 
+/* Directories only wrapped for marks skip building their path. */
 struct hidden_dirent {
     struct rb_node node;
     struct file *file;
     struct file_operations *fops;
+    struct file_operations *wrap;
+    bool named;
+    bool marked;
 };
 
 #define node_to_hidden(ptr) \
     rb_entry(ptr, struct hidden_dirent, node)
 
-static inline char *
-inode_name(struct inode *inode, char *buffer, bool *noalias)
+/*
+ * Rename hooks run before the rename, the rules of the old name are
+ * dropped by a worker once the directory lock held across it is
+ * released and the dentry really moved.
+ */
+struct hidden_rename {
+    struct work_struct work;
+    struct dentry *old_dentry;
+    struct dentry *new_dentry;
+    struct dentry *new_dir;
+    char *new;
+    char old[];
+};
+
+struct path lksu_hidden_root;
+static struct mnt_namespace *hidden_mnt_ns;
+static struct workqueue_struct *rename_wq;
+
+static inline struct pid_namespace *
+proc_ns(struct super_block *sb)
+{
+#if LINUX_VERSION_CODE >= KERNEL_VERSION(5, 8, 0)
+    return proc_pid_ns(sb);
+#else
+    return sb->s_fs_info;
+#endif
+}
+
+/* Only plain decimal names of the procfs root are processes. */
+static bool
+proc_name_pid(const char *name, unsigned int namlen, pid_t *nr)
+{
+    pid_t value;
+
+    if (!namlen || namlen > 9)
+        return false;
+
+    for (value = 0; namlen--; ++name) {
+        if (!isdigit(*name))
+            return false;
+        value = value * 10 + *name - '0';
+    }
+
+    *nr = value;
+    return true;
+}
+
+/*
+ * Hidden processes are matched on the first component below the
+ * procfs root, parsed as a pid, without building the path string.
+ */
+static bool
+proc_dentry_hidden(struct dentry *dentry)
+{
+    struct dentry *parent;
+    bool hidden;
+    pid_t nr;
+
+    if (!lksu_pids_active() || dentry->d_sb->s_magic != PROC_SUPER_MAGIC)
+        return false;
+
+    hidden = false;
+    rcu_read_lock();
+
+    for (;;) {
+        parent = READ_ONCE(dentry->d_parent);
+        if (parent == dentry || IS_ROOT(parent))
+            break;
+        dentry = parent;
+    }
+
+    if (!IS_ROOT(dentry) &&
+        proc_name_pid(dentry->d_name.name, dentry->d_name.len, &nr))
+        hidden = lksu_pid_check_nr(nr, proc_ns(dentry->d_sb));
+
+    rcu_read_unlock();
+
+    return hidden;
+}
+
+static bool
+proc_inode_hidden(struct inode *inode)
 {
     struct dentry *dentry;
-    char *name;
+    bool hidden;
+
+    if (!lksu_pids_active() || inode->i_sb->s_magic != PROC_SUPER_MAGIC)
+        return false;
 
-    *noalias = false;
     dentry = d_find_alias(inode);
-    if (!dentry) {
-        *noalias = true;
-        return NULL;
-    }
+    if (!dentry)
+        return false;
 
-    name = dentry_path_raw(dentry, buffer, PATH_MAX);
+    hidden = proc_dentry_hidden(dentry);
     dput(dentry);
 
-    return name;
+    return hidden;
+}
+
+/*
+ * Rules match whole paths, so a dentry can only be hidden when its own
+ * name is the basename of some rule, and most are turned away here
+ * before any path is built. A racing d_move may pair a name with the
+ * length of another, so the name is loaded with acquire and only read
+ * up to its NUL like prepend_name() does, rename_lock then retries
+ * whatever was torn. On procfs /proc/lksu
+ * hides its whole subtree, so every component up to the root counts
+ * there. Mount roots show the name of their mountpoint in d_path and
+ * always take the full check.
+ */
+static bool
+hidden_name_maybe(struct dentry *dentry, const struct vfsmount *mnt)
+{
+    const struct dentry *walk;
+    const char *name;
+    unsigned int seq;
+    bool maybe, proc;
+
+    if (IS_ROOT(dentry) || (mnt && dentry == mnt->mnt_root))
+        return true;
+
+    proc = dentry->d_sb->s_magic == PROC_SUPER_MAGIC;
+    rcu_read_lock();
+
+    do {
+        seq = read_seqbegin(&rename_lock);
+        walk = dentry;
+        do {
+            name = (const char *)smp_load_acquire(&walk->d_name.name);
+            maybe = lksu_table_base_check(
+                name, strnlen(name, READ_ONCE(walk->d_name.len))
+            );
+            walk = READ_ONCE(walk->d_parent);
+        } while (!maybe && proc && !IS_ROOT(walk));
+    } while (read_seqretry(&rename_lock, seq));
+
+    rcu_read_unlock();
+
+    return maybe;
 }
 
 static bool
@@ -92,13 +242,24 @@ filldir(struct dir_context *ctx, const char *name, int namlen,
 {
     struct iter_context *ictx;
     struct dir_context *octx;
+    pid_t nr;
 
     ictx = container_of(ctx, struct iter_context, ctx);
-    strcpy(ictx->name, name);
+    if (ictx->pid_ns && proc_name_pid(name, namlen, &nr) &&
+        lksu_pid_check_nr(nr, ictx->pid_ns))
+        return true;
 
-    if (lksu_table_gfile_check(ictx->path))
+    if (ictx->sb && lksu_mark_check_ino(ictx->sb, ino))
         return true;
 
+    if (ictx->path && lksu_table_base_check(name, namlen)) {
+        memcpy(ictx->name, name, namlen);
+        ictx->name[namlen] = '\0';
+
+        if (lksu_table_file_check(ictx->path))
+            return true;
+    }
+
     octx = ictx->octx;
     octx->pos = ictx->ctx.pos;
 
@@ -112,61 +273,119 @@ iter_file(struct file *file, struct dir_context *dctx)
     struct iter_context ictx;
     struct rb_node *rb;
     char *buffer, *name;
-    int retval;
+    int retval, idx;
 
+    idx = srcu_read_lock(&dirent_srcu);
     spin_lock(&dirent_lock);
     rb = lksu_rb_find(file, &hidden_dirent, hidden_find);
-    BUG_ON(!rb);
     spin_unlock(&dirent_lock);
 
-    buffer = kmem_cache_alloc(filldir_cache, GFP_KERNEL);
-    if (unlikely(!buffer))
-        return -ENOMEM;
+    /* Unwrapped by the unload after this call was dispatched. */
+    if (unlikely(!rb)) {
+        retval = READ_ONCE(file->f_op)->iterate_shared(file, dctx);
+        goto unlock;
+    }
 
-    name = file_path(file, buffer, PATH_MAX);
-    if ((retval = PTR_ERR_OR_ZERO(name)))
-        goto finish;
+    hidden = node_to_hidden(rb);
+    buffer = NULL;
+
+    ictx.path = NULL;
+    if (hidden->named) {
+        buffer = kmem_cache_alloc(filldir_cache, GFP_KERNEL);
+        if (unlikely(!buffer)) {
+            retval = -ENOMEM;
+            goto unlock;
+        }
+
+        name = file_path(file, buffer, PATH_MAX);
+        if ((retval = PTR_ERR_OR_ZERO(name)))
+            goto finish;
+
+        ictx.path = name;
+        ictx.name = name + strlen(name);
+        *ictx.name++ = '/';
+    }
 
     ictx.ctx.actor = filldir;
     ictx.ctx.pos = dctx->pos;
     ictx.octx = dctx;
 
-    ictx.path = name;
-    ictx.name = name + strlen(name);
-    *ictx.name++ = '/';
+    ictx.pid_ns = NULL;
+    if (file->f_path.dentry->d_sb->s_magic == PROC_SUPER_MAGIC &&
+        IS_ROOT(file->f_path.dentry))
+        ictx.pid_ns = proc_ns(file->f_path.dentry->d_sb);
+
+    ictx.sb = hidden->marked ? file->f_path.dentry->d_sb : NULL;
 
-    hidden = node_to_hidden(rb);
     retval = hidden->fops->iterate_shared(file, &ictx.ctx);
     dctx->pos = ictx.ctx.pos;
 
 finish:
-    kmem_cache_free(filldir_cache, buffer);
+    if (buffer)
+        kmem_cache_free(filldir_cache, buffer);
+unlock:
+    srcu_read_unlock(&dirent_srcu, idx);
     return retval;
 }
 
 static int
 release_dirent(struct inode *inode, struct file *file)
 {
+    const struct file_operations *fops;
     struct hidden_dirent *hidden;
     struct rb_node *rb;
+    int retval, idx;
 
+    idx = srcu_read_lock(&dirent_srcu);
     spin_lock(&dirent_lock);
     rb = lksu_rb_find(file, &hidden_dirent, hidden_find);
-    BUG_ON(!rb);
-
-    rb_erase(rb, &hidden_dirent);
+    if (rb) {
+        rb_erase(rb, &hidden_dirent);
+        hidden = node_to_hidden(rb);
+        WRITE_ONCE(file->f_op, hidden->fops);
+    }
     spin_unlock(&dirent_lock);
 
-    hidden = node_to_hidden(rb);
-    kfree(file->f_op);
+    if (rb) {
+        kfree(hidden->wrap);
+        kfree(hidden);
+    }
 
-    file->f_op = hidden->fops;
-    kfree(hidden);
+    retval = 0;
+    fops = READ_ONCE(file->f_op);
+    if (fops->release)
+        retval = fops->release(inode, file);
 
-    if (file->f_op->release)
-        return file->f_op->release(inode, file);
+    if (rb)
+        module_put(THIS_MODULE);
+    srcu_read_unlock(&dirent_srcu, idx);
 
-    return 0;
+    return retval;
+}
+
+/* Only a forced unload leaves wrapped files behind. */
+static void
+dirent_unwrap_all(void)
+{
+    struct hidden_dirent *hidden, *tmp;
+    struct rb_root dead = RB_ROOT;
+    struct rb_node *rb;
+
+    spin_lock(&dirent_lock);
+    while ((rb = rb_first(&hidden_dirent))) {
+        rb_erase(rb, &hidden_dirent);
+        hidden = node_to_hidden(rb);
+        WRITE_ONCE(hidden->file->f_op, hidden->fops);
+        lksu_rb_add(rb, &dead, hidden_cmp);
+    }
+    spin_unlock(&dirent_lock);
+
+    synchronize_srcu(&dirent_srcu);
+
+    rbtree_postorder_for_each_entry_safe(hidden, tmp, &dead, node) {
+        kfree(hidden->wrap);
+        kfree(hidden);
+    }
 }
 
 int
@@ -175,27 +394,33 @@ lksu_hidden_dirent(struct file *file)
     struct file_operations *fops;
     struct hidden_dirent *dirent;
     char *buffer, *name;
-    bool hidden;
+    bool hidden, marked;
+    u64 start;
     int retval;
 
+    start = lksu_trace_clock();
     buffer = __getname();
     if (unlikely(!buffer))
         return -ENOMEM;
 
     fops = NULL;
-    hidden = NULL;
+    dirent = NULL;
 
     name = file_path(file, buffer, PATH_MAX);
     if ((retval = PTR_ERR_OR_ZERO(name)))
         goto exit;
 
-    hidden = lksu_table_gdirent_check(name);
-#if LKSU_DEBUG
+    hidden = lksu_table_dirent_check(name);
+    if (start)
+        lksu_trace_record(LKSU_TRACE_DIRENT, name, hidden, start);
+
+#ifdef CONFIG_LKSU_DEBUG
     pr_info("hidden dirent '%s': %s\n", name,
             hidden ? "true" : "false");
 #endif
 
-    if (!hidden)
+    marked = lksu_mark_check_dir(file_inode(file));
+    if (!hidden && !marked)
         goto exit;
 
     fops = kmalloc(sizeof(*fops), GFP_KERNEL);
@@ -216,10 +441,14 @@ lksu_hidden_dirent(struct file *file)
 
     dirent->file = file;
     dirent->fops = (void *)file->f_op;
-    file->f_op = fops;
+    dirent->wrap = fops;
+    dirent->named = hidden;
+    dirent->marked = marked;
 
+    __module_get(THIS_MODULE);
     spin_lock(&dirent_lock);
     lksu_rb_add(&dirent->node, &hidden_dirent, hidden_cmp);
+    WRITE_ONCE(file->f_op, fops);
     spin_unlock(&dirent_lock);
 
     __putname(buffer);
@@ -236,10 +465,20 @@ int
 lksu_hidden_file(struct file *file, bool *hidden)
 {
     char *buffer, *name;
+    u64 start;
     int retval;
 
-    *hidden = false;
+    *hidden = lksu_mark_check(file_inode(file)) ||
+              proc_dentry_hidden(file->f_path.dentry);
+    if (*hidden) {
+        lksu_event_deny(LKSU_TRACE_FILE, NULL);
+        return 0;
+    }
 
+    if (!hidden_name_maybe(file->f_path.dentry, file->f_path.mnt))
+        return 0;
+
+    start = lksu_trace_clock();
     buffer = __getname();
     if (unlikely(!buffer))
         return -ENOMEM;
@@ -248,10 +487,15 @@ lksu_hidden_file(struct file *file, bool *hidden)
     if ((retval = PTR_ERR_OR_ZERO(name)))
         goto finish;
 
-    if (lksu_table_gfile_check(name))
+    if (lksu_table_file_check(name)) {
+        lksu_event_deny(LKSU_TRACE_FILE, name);
         *hidden = true;
+    }
+
+    if (start)
+        lksu_trace_record(LKSU_TRACE_FILE, name, *hidden, start);
 
-#if LKSU_DEBUG
+#ifdef CONFIG_LKSU_DEBUG
     pr_info("hidden file '%s': %s\n", name,
             *hidden ? "true" : "false");
 #endif
@@ -265,10 +509,20 @@ int
 lksu_hidden_path(const struct path *path, bool *hidden)
 {
     char *buffer, *name;
+    u64 start;
     int retval;
 
-    *hidden = false;
+    *hidden = lksu_mark_check(d_backing_inode(path->dentry)) ||
+              proc_dentry_hidden(path->dentry);
+    if (*hidden) {
+        lksu_event_deny(LKSU_TRACE_PATH, NULL);
+        return 0;
+    }
 
+    if (!hidden_name_maybe(path->dentry, path->mnt))
+        return 0;
+
+    start = lksu_trace_clock();
     buffer = __getname();
     if (unlikely(!buffer))
         return -ENOMEM;
@@ -277,10 +531,15 @@ lksu_hidden_path(const struct path *path, bool *hidden)
     if ((retval = PTR_ERR_OR_ZERO(name)))
         goto finish;
 
-    if (lksu_table_gfile_check(name))
+    if (lksu_table_file_check(name)) {
+        lksu_event_deny(LKSU_TRACE_PATH, name);
         *hidden = true;
+    }
 
-#if LKSU_DEBUG
+    if (start)
+        lksu_trace_record(LKSU_TRACE_PATH, name, *hidden, start);
+
+#ifdef CONFIG_LKSU_DEBUG
     pr_info("hidden path '%s': %s\n", name,
             *hidden ? "true" : "false");
 #endif
@@ -293,37 +552,168 @@ finish:
 int
 lksu_hidden_inode(struct inode *inode, bool *hidden)
 {
+    struct dentry *dentry;
     char *buffer, *name;
-    bool noalias;
-    int retval = 0;
+    u64 start;
+    int retval;
 
-    *hidden = false;
+    *hidden = lksu_mark_check(inode) || proc_inode_hidden(inode);
+    if (*hidden) {
+        lksu_event_deny(LKSU_TRACE_INODE, NULL);
+        return 0;
+    }
 
-    buffer = __getname();
-    if (unlikely(!buffer))
-        return -ENOMEM;
+    dentry = d_find_alias(inode);
+    if (!dentry)
+        return 0;
 
-    name = inode_name(inode, buffer, &noalias);
-    if (noalias) {
-        retval = 0;
-        goto finish;
+    retval = 0;
+    if (!hidden_name_maybe(dentry, NULL))
+        goto put_dentry;
+
+    start = lksu_trace_clock();
+    buffer = __getname();
+    if (unlikely(!buffer)) {
+        retval = -ENOMEM;
+        goto put_dentry;
     }
 
-    if (IS_ERR_OR_NULL(name)) {
-        retval = name ? PTR_ERR_OR_ZERO(name) : -EFAULT;
+    name = dentry_path_raw(dentry, buffer, PATH_MAX);
+    if ((retval = PTR_ERR_OR_ZERO(name)))
         goto finish;
-    }
 
-    if (lksu_table_gfile_check(name))
+    if (lksu_table_file_check(name)) {
+        lksu_event_deny(LKSU_TRACE_INODE, name);
         *hidden = true;
+    }
 
-#if LKSU_DEBUG
+    if (start)
+        lksu_trace_record(LKSU_TRACE_INODE, name, *hidden, start);
+
+#ifdef CONFIG_LKSU_DEBUG
     pr_info("hidden inode '%s': %s\n", name,
             *hidden ? "true" : "false");
 #endif
 
 finish:
     __putname(buffer);
+put_dentry:
+    dput(dentry);
+    return retval;
+}
+
+/*
+ * Paths of dentries are relative to their superblock, they are only
+ * the absolute paths rules are written with on the system root.
+ */
+bool
+lksu_hidden_rooted(const struct dentry *dentry)
+{
+    struct dentry *root;
+
+    root = lksu_hidden_root.dentry;
+    return root && IS_ROOT(root) && dentry->d_sb == root->d_sb;
+}
+
+static void
+hidden_rename_work(struct work_struct *work)
+{
+    struct hidden_rename *rename;
+    struct inode *dir;
+    char *buffer, *name;
+
+    rename = container_of(work, struct hidden_rename, work);
+
+    dir = d_inode(rename->new_dir);
+    inode_lock_shared(dir);
+    inode_unlock_shared(dir);
+
+    /* Links and exchanges leave the target hashed, failures the name. */
+    buffer = __getname();
+    if (likely(buffer)) {
+        name = dentry_path_raw(rename->old_dentry, buffer, PATH_MAX);
+        if (!IS_ERR(name) && !strcmp(name, rename->new) &&
+            d_unhashed(rename->new_dentry))
+            lksu_table_prune(hidden_mnt_ns, rename->old);
+        __putname(buffer);
+    }
+
+    dput(rename->new_dir);
+    dput(rename->new_dentry);
+    dput(rename->old_dentry);
+    kfree(rename);
+}
+
+static void
+hidden_rename_defer(struct dentry *old_dentry, struct dentry *new_dentry,
+                    const char *oname, const char *nname)
+{
+    struct hidden_rename *rename;
+    size_t olength, nlength;
+
+    if (!rename_wq)
+        return;
+
+    olength = strlen(oname) + 1;
+    nlength = strlen(nname) + 1;
+
+    rename = kmalloc(struct_size(rename, old, olength + nlength), GFP_KERNEL);
+    if (unlikely(!rename))
+        return;
+
+    memcpy(rename->old, oname, olength);
+    rename->new = rename->old + olength;
+    memcpy(rename->new, nname, nlength);
+
+    rename->old_dentry = dget(old_dentry);
+    rename->new_dentry = dget(new_dentry);
+    rename->new_dir = dget_parent(new_dentry);
+
+    INIT_WORK(&rename->work, hidden_rename_work);
+    queue_work(rename_wq, &rename->work);
+}
+
+int
+lksu_hidden_rename(struct dentry *old_dentry, struct dentry *new_dentry)
+{
+    char *obuffer, *nbuffer, *oname, *nname;
+    int retval;
+
+    if (lksu_table_file_empty() || lksu_table_sealed())
+        return 0;
+
+    if (!lksu_hidden_rooted(old_dentry))
+        return 0;
+
+    obuffer = __getname();
+    if (unlikely(!obuffer))
+        return -ENOMEM;
+
+    nbuffer = __getname();
+    if (unlikely(!nbuffer)) {
+        retval = -ENOMEM;
+        goto free_old;
+    }
+
+    oname = dentry_path_raw(old_dentry, obuffer, PATH_MAX);
+    nname = dentry_path_raw(new_dentry, nbuffer, PATH_MAX);
+    /* Too long to be written as a rule, nothing to follow. */
+    retval = 0;
+    if (IS_ERR(oname) || IS_ERR(nname))
+        goto free_new;
+
+    retval = lksu_table_rename(hidden_mnt_ns, oname, nname);
+    if (!retval)
+        hidden_rename_defer(old_dentry, new_dentry, oname, nname);
+
+#ifdef CONFIG_LKSU_DEBUG
+    pr_info("hidden rename '%s' -> '%s': %d\n", oname, nname, retval);
+#endif
+
+free_new:
+    __putname(nbuffer);
+free_old:
+    __putname(obuffer);
     return retval;
 }
 
@@ -338,11 +728,25 @@ lksu_hidden_init(void)
     if (!filldir_cache)
         return -ENOMEM;
 
+    rename_wq = alloc_workqueue("lksu-rename", WQ_UNBOUND, 0);
+    if (!rename_wq) {
+        kmem_cache_destroy(filldir_cache);
+        return -ENOMEM;
+    }
+
+    get_fs_root(init_task.fs, &lksu_hidden_root);
+    hidden_mnt_ns = init_task.nsproxy->mnt_ns;
+
     return 0;
 }
 
 void
 lksu_hidden_exit(void)
 {
+    dirent_unwrap_all();
+    if (rename_wq)
+        destroy_workqueue(rename_wq);
+    if (lksu_hidden_root.dentry)
+        path_put(&lksu_hidden_root);
     kmem_cache_destroy(filldir_cache);
 }
@@ -21,6 +21,14 @@ lksu_hidden_path(const struct path *path, bool *hidden);
 extern int
 lksu_hidden_inode(struct inode *inode, bool *hidden);
 
+extern struct path lksu_hidden_root;
+
+extern bool
+lksu_hidden_rooted(const struct dentry *dentry);
+
+extern int
+lksu_hidden_rename(struct dentry *old_dentry, struct dentry *new_dentry);
+
 extern int
 lksu_hidden_init(void);
 
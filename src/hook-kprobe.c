@@ -46,6 +46,7 @@ kprobe_file_open(struct kretprobe_instance *ri, struct pt_regs *regs)
     return 0;
 }
 
+#ifdef CONFIG_LKSU_HOOK_GETATTR
 static int
 kprobe_inode_getattr(struct kretprobe_instance *ri, struct pt_regs *regs)
 {
@@ -57,9 +58,6 @@ kprobe_inode_getattr(struct kretprobe_instance *ri, struct pt_regs *regs)
     args = (void *)ri->data;
     path = (struct path *)args[0];
 
-    if (unlikely(IS_PRIVATE(d_backing_inode(path->dentry))))
-        return 0;
-
     retval = hook_inode_getattr(path);
     if (retval)
         regs_set_return_value(regs, retval);
@@ -68,6 +66,7 @@ kprobe_inode_getattr(struct kretprobe_instance *ri, struct pt_regs *regs)
 
     return 0;
 }
+#endif
 
 static int
 kprobe_inode_permission(struct kretprobe_instance *ri, struct pt_regs *regs)
@@ -80,9 +79,6 @@ kprobe_inode_permission(struct kretprobe_instance *ri, struct pt_regs *regs)
     args = (void *)ri->data;
     inode = (struct inode *)args[0];
 
-    if (unlikely(IS_PRIVATE(inode)))
-        return 0;
-
     retval = hook_inode_permission(inode);
     if (retval)
         regs_set_return_value(regs, retval);
@@ -117,6 +113,95 @@ kprobe_task_prctl(struct kretprobe_instance *ri, struct pt_regs *regs)
     return 0;
 }
 
+static int
+kprobe_task_free(struct kretprobe_instance *ri, struct pt_regs *regs)
+{
+    struct task_struct *task;
+
+    task = (struct task_struct *)regs_get_kernel_argument(regs, 0);
+    hook_task_free(task);
+
+    /* Nothing to do on return, give the instance back right away. */
+    return 1;
+}
+
+#ifdef CONFIG_LKSU_WHITELIST_EXE
+static int
+kprobe_task_alloc(struct kretprobe_instance *ri, struct pt_regs *regs)
+{
+    struct task_struct *task;
+
+    task = (struct task_struct *)regs_get_kernel_argument(regs, 0);
+    hook_task_alloc(task);
+
+    return 1;
+}
+
+static int
+kprobe_bprm_committed_creds(struct kretprobe_instance *ri, struct pt_regs *regs)
+{
+    struct linux_binprm *bprm;
+
+    bprm = (struct linux_binprm *)regs_get_kernel_argument(regs, 0);
+    hook_bprm_committed_creds(bprm);
+
+    return 1;
+}
+#endif
+
+static int
+kprobe_d_instantiate(struct kretprobe_instance *ri, struct pt_regs *regs)
+{
+    struct dentry *dentry;
+    struct inode *inode;
+
+    dentry = (struct dentry *)regs_get_kernel_argument(regs, 0);
+    inode = (struct inode *)regs_get_kernel_argument(regs, 1);
+    hook_d_instantiate(dentry, inode);
+
+    return 1;
+}
+
+static int
+kprobe_inode_free(struct kretprobe_instance *ri, struct pt_regs *regs)
+{
+    struct inode *inode;
+
+    inode = (struct inode *)regs_get_kernel_argument(regs, 0);
+    hook_inode_free(inode);
+
+    return 1;
+}
+
+static int
+kprobe_inode_rename(struct kretprobe_instance *ri, struct pt_regs *regs)
+{
+    struct dentry *old_dentry, *new_dentry;
+    unsigned int flags;
+
+    old_dentry = (struct dentry *)regs_get_kernel_argument(regs, 1);
+    new_dentry = (struct dentry *)regs_get_kernel_argument(regs, 3);
+    flags = regs_get_kernel_argument(regs, 4);
+
+    hook_inode_rename(old_dentry, new_dentry);
+    if (flags & RENAME_EXCHANGE)
+        hook_inode_rename(new_dentry, old_dentry);
+
+    return 1;
+}
+
+static int
+kprobe_inode_link(struct kretprobe_instance *ri, struct pt_regs *regs)
+{
+    struct dentry *old_dentry, *new_dentry;
+
+    old_dentry = (struct dentry *)regs_get_kernel_argument(regs, 0);
+    new_dentry = (struct dentry *)regs_get_kernel_argument(regs, 2);
+    hook_inode_rename(old_dentry, new_dentry);
+
+    return 1;
+}
+
 static struct kretprobe *
 kprobe_hooks[] = {
     &(struct kretprobe) {
@@ -125,12 +210,14 @@ kprobe_hooks[] = {
         .handler = kprobe_file_open,
         .data_size = sizeof(unsigned long [1]),
     },
+#ifdef CONFIG_LKSU_HOOK_GETATTR
     &(struct kretprobe) {
         .kp.symbol_name = "security_inode_getattr",
         .entry_handler = kprobe_get_args,
         .handler = kprobe_inode_getattr,
         .data_size = sizeof(unsigned long [1]),
     },
+#endif
     &(struct kretprobe) {
         .kp.symbol_name = "security_inode_permission",
         .entry_handler = kprobe_get_args,
@@ -143,6 +230,36 @@ kprobe_hooks[] = {
         .handler = kprobe_task_prctl,
         .data_size = sizeof(unsigned long [2]),
     },
+    &(struct kretprobe) {
+        .kp.symbol_name = "security_task_free",
+        .entry_handler = kprobe_task_free,
+    },
+#ifdef CONFIG_LKSU_WHITELIST_EXE
+    &(struct kretprobe) {
+        .kp.symbol_name = "security_task_alloc",
+        .entry_handler = kprobe_task_alloc,
+    },
+    &(struct kretprobe) {
+        .kp.symbol_name = "security_bprm_committed_creds",
+        .entry_handler = kprobe_bprm_committed_creds,
+    },
+#endif
+    &(struct kretprobe) {
+        .kp.symbol_name = "security_d_instantiate",
+        .entry_handler = kprobe_d_instantiate,
+    },
+    &(struct kretprobe) {
+        .kp.symbol_name = "security_inode_free",
+        .entry_handler = kprobe_inode_free,
+    },
+    &(struct kretprobe) {
+        .kp.symbol_name = "security_inode_rename",
+        .entry_handler = kprobe_inode_rename,
+    },
+    &(struct kretprobe) {
+        .kp.symbol_name = "security_inode_link",
+        .entry_handler = kprobe_inode_link,
+    },
 };
 
 static __init int
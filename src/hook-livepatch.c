@@ -24,12 +24,10 @@ livepatch_file_open(struct file *file)
     return fsnotify_perm(file, MAY_OPEN);
 }
 
+#ifdef CONFIG_LKSU_HOOK_GETATTR
 static int
 livepatch_inode_getattr(const struct path *path)
 {
-    if (unlikely(IS_PRIVATE(d_backing_inode(path->dentry))))
-        return 0;
-
 #if 1
     return hook_inode_getattr(path);
 #else /* For debug */
@@ -37,13 +35,11 @@ livepatch_inode_getattr(const struct path *path)
     return 0;
 #endif
 }
+#endif
 
 static int
 livepatch_inode_permission(struct inode *inode, int mask)
 {
-    if (unlikely(IS_PRIVATE(inode)))
-        return 0;
-
 #if 1
     return hook_inode_permission(inode);
 #else /* For debug */
@@ -67,17 +63,25 @@ livepatch_task_prctl(int option, unsigned long arg2, unsigned long arg3,
     return retval;
 }
 
-/* TODO: Avoid replacing LSM */
+/*
+ * TODO: Avoid replacing LSM
+ * security_task_free and security_inode_free are left alone as they
+ * free every LSM blob, hidden pids of dead processes are pruned on the
+ * next add instead, xattr marks and executable whitelists are not
+ * supported.
+ */
 static struct klp_func
 livepatch_hooks[] = {
     {
         .old_name = "security_file_open",
         .new_func = livepatch_file_open,
     },
+#ifdef CONFIG_LKSU_HOOK_GETATTR
     {
         .old_name = "security_inode_getattr",
         .new_func = livepatch_inode_getattr,
     },
+#endif
     {
         .old_name = "security_inode_permission",
         .new_func = livepatch_inode_permission,
@@ -14,6 +14,7 @@ lsm_file_open(struct file *file)
 #endif
 }
 
+#ifdef CONFIG_LKSU_HOOK_GETATTR
 static int
 lsm_inode_getattr(const struct path *path)
 {
@@ -24,6 +25,7 @@ lsm_inode_getattr(const struct path *path)
     return 0;
 #endif
 }
+#endif
 
 static int
 lsm_inode_permission(struct inode *inode, int mask)
@@ -36,6 +38,58 @@ lsm_inode_permission(struct inode *inode, int mask)
 #endif
 }
 
+static void
+lsm_task_free(struct task_struct *task)
+{
+    hook_task_free(task);
+}
+
+#ifdef CONFIG_LKSU_WHITELIST_EXE
+static int
+lsm_task_alloc(struct task_struct *task, unsigned long clone_flags)
+{
+    hook_task_alloc(task);
+    return 0;
+}
+
+#if LINUX_VERSION_CODE >= KERNEL_VERSION(6, 6, 0)
+static void
+lsm_bprm_committed_creds(const struct linux_binprm *bprm)
+#else
+static void
+lsm_bprm_committed_creds(struct linux_binprm *bprm)
+#endif
+{
+    hook_bprm_committed_creds(bprm);
+}
+#endif
+
+static void
+lsm_d_instantiate(struct dentry *dentry, struct inode *inode)
+{
+    hook_d_instantiate(dentry, inode);
+}
+
+static void
+lsm_inode_free_security(struct inode *inode)
+{
+    hook_inode_free(inode);
+}
+
+static int
+lsm_inode_rename(struct inode *old_dir, struct dentry *old_dentry,
+                 struct inode *new_dir, struct dentry *new_dentry)
+{
+    return hook_inode_rename(old_dentry, new_dentry);
+}
+
+static int
+lsm_inode_link(struct dentry *old_dentry, struct inode *dir,
+               struct dentry *new_dentry)
+{
+    return hook_inode_rename(old_dentry, new_dentry);
+}
+
 static int
 lsm_task_prctl(int option, unsigned long arg2, unsigned long arg3,
                unsigned long arg4, unsigned long arg5)
@@ -54,8 +108,19 @@ lsm_task_prctl(int option, unsigned long arg2, unsigned long arg3,
 static struct security_hook_list
 lsm_hooks[] = {
     LSM_HOOK_INIT(file_open, lsm_file_open),
+#ifdef CONFIG_LKSU_HOOK_GETATTR
     LSM_HOOK_INIT(inode_getattr, lsm_inode_getattr),
+#endif
     LSM_HOOK_INIT(inode_permission, lsm_inode_permission),
+    LSM_HOOK_INIT(d_instantiate, lsm_d_instantiate),
+    LSM_HOOK_INIT(inode_free_security, lsm_inode_free_security),
+    LSM_HOOK_INIT(inode_rename, lsm_inode_rename),
+    LSM_HOOK_INIT(inode_link, lsm_inode_link),
+    LSM_HOOK_INIT(task_free, lsm_task_free),
+#ifdef CONFIG_LKSU_WHITELIST_EXE
+    LSM_HOOK_INIT(task_alloc, lsm_task_alloc),
+    LSM_HOOK_INIT(bprm_committed_creds, lsm_bprm_committed_creds),
+#endif
     LSM_HOOK_INIT(task_prctl, lsm_task_prctl),
 };
 
@@ -11,17 +11,36 @@
 #include "token.h"
 #include "hidden.h"
 #include "tables.h"
+#include "trace.h"
+#include "pids.h"
+#include "marks.h"
+#include "events.h"
+#include "cgroups.h"
+#include "exes.h"
 
 #include <linux/module.h>
 #include <linux/fs.h>
+#include <linux/namei.h>
+#include <linux/path.h>
 #include <linux/slab.h>
 #include <linux/cred.h>
+#include <linux/pid.h>
+#include <linux/nsproxy.h>
+#include <linux/proc_ns.h>
+#include <linux/kprobes.h>
+#include <linux/sched/task.h>
 #include <linux/uaccess.h>
 #include <linux/printk.h>
 #include <linux/rbtree.h>
 #include <linux/version.h>
 #include <linux/lsm_hooks.h>
 #include <linux/errname.h>
+#include <linux/magic.h>
+#include <linux/percpu.h>
+#include <linux/workqueue.h>
+#include <linux/seq_file.h>
+#include <linux/sched/clock.h>
+#include <linux/math64.h>
 
 #define LSM_RET_DEFAULT(NAME) (NAME##_default)
 #define DECLARE_LSM_RET_DEFAULT_void(DEFAULT, NAME)
@@ -33,55 +52,350 @@
 #include <linux/lsm_hook_defs.h>
 #undef LSM_HOOK
 
+#define FILTER_SAMPLE_MASK 255
+#define FILTER_SORT_PERIOD (10 * HZ)
+#define FILTER_ORDER_SHIFT 4
+
 static bool enabled __read_mostly;
 
-static inline bool
-hook_whitelist(void)
+/*
+ * Cheap predicates run before any path is formatted, each one lets
+ * the hook return early. They only ever skip the check, so their
+ * order does not change any verdict and is free to follow the load:
+ * every cpu counts how often a stage ran and rejected, samples its
+ * cost once in a while, and a periodic work sorts the stages by cost
+ * over rejection rate. The order is packed in one word, a reader sees
+ * either the old or the new one.
+ */
+enum hook_filter {
+    FILTER_DISABLED = 0,
+    FILTER_PRIVATE,
+    FILTER_UID,
+    FILTER_CGROUP,
+    FILTER_EXE,
+    FILTER_NR,
+};
+
+static const char *const
+filter_names[FILTER_NR] = {
+    [FILTER_DISABLED] = "disabled",
+    [FILTER_PRIVATE] = "private",
+    [FILTER_UID] = "uid",
+    [FILTER_CGROUP] = "cgroup",
+    [FILTER_EXE] = "exe",
+};
+
+struct filter_stats {
+    unsigned long runs[FILTER_NR];
+    unsigned long rejects[FILTER_NR];
+    unsigned long cost[FILTER_NR];
+    unsigned long samples[FILTER_NR];
+    unsigned long calls;
+};
+
+struct filter_window {
+    unsigned long runs;
+    unsigned long rejects;
+    unsigned long cost;
+    unsigned long samples;
+};
+
+static unsigned long filter_order __read_mostly;
+static DEFINE_PER_CPU(struct filter_stats, filter_stats);
+static struct filter_window filter_last[FILTER_NR];
+
+static void
+filter_sort(struct work_struct *work);
+static DECLARE_DELAYED_WORK(filter_work, filter_sort);
+
+static __always_inline bool
+filter_stage(enum hook_filter stage, const struct inode *inode)
 {
-    if (!READ_ONCE(enabled))
-        return true;
+    switch (stage) {
+        case FILTER_DISABLED:
+            return !READ_ONCE(enabled);
+
+        case FILTER_PRIVATE:
+            return unlikely(IS_PRIVATE(inode));
+
+        case FILTER_UID:
+            return IS_ENABLED(CONFIG_LKSU_WHITELIST_UID) &&
+                   lksu_table_guid_check(current_uid());
+
+        case FILTER_CGROUP:
+            return IS_ENABLED(CONFIG_LKSU_WHITELIST_CGROUP) &&
+                   lksu_cgroup_check();
+
+        case FILTER_EXE:
+            return IS_ENABLED(CONFIG_LKSU_WHITELIST_EXE) &&
+                   lksu_exe_check();
 
-    if (lksu_table_guid_check(current_uid()))
-        return true;
+        default:
+            return false;
+    }
+}
+
+static bool
+hook_prefilter(const struct inode *inode)
+{
+    enum hook_filter stage;
+    unsigned long order;
+    unsigned int index;
+    bool sample, reject;
+    u64 start;
+
+    order = READ_ONCE(filter_order);
+    sample = !(this_cpu_inc_return(filter_stats.calls) & FILTER_SAMPLE_MASK);
+
+    for (index = 0; index < FILTER_NR; ++index) {
+        stage = order & (BIT(FILTER_ORDER_SHIFT) - 1);
+        order >>= FILTER_ORDER_SHIFT;
+
+        this_cpu_inc(filter_stats.runs[stage]);
+        if (unlikely(sample)) {
+            start = local_clock();
+            reject = filter_stage(stage, inode);
+            this_cpu_add(filter_stats.cost[stage], local_clock() - start);
+            this_cpu_inc(filter_stats.samples[stage]);
+        } else {
+            reject = filter_stage(stage, inode);
+        }
+
+        if (reject) {
+            this_cpu_inc(filter_stats.rejects[stage]);
+            return true;
+        }
+    }
 
     return false;
 }
 
+static void
+filter_sum(struct filter_window *total)
+{
+    struct filter_stats *stats;
+    unsigned int stage;
+    int cpu;
+
+    memset(total, 0, sizeof(*total) * FILTER_NR);
+    for_each_possible_cpu(cpu) {
+        stats = per_cpu_ptr(&filter_stats, cpu);
+        for (stage = 0; stage < FILTER_NR; ++stage) {
+            total[stage].runs += READ_ONCE(stats->runs[stage]);
+            total[stage].rejects += READ_ONCE(stats->rejects[stage]);
+            total[stage].cost += READ_ONCE(stats->cost[stage]);
+            total[stage].samples += READ_ONCE(stats->samples[stage]);
+        }
+    }
+}
+
+/*
+ * Expected cost per rejection over the last period, the stage that
+ * pays least for each early exit goes first. Stages that never reject
+ * sort last, ties keep their previous position. A stage without a
+ * cost sample in the period has no score and stays where it is.
+ */
+static bool
+filter_score(const struct filter_window *now, const struct filter_window *last,
+             u64 *score)
+{
+    unsigned long runs, rejects, samples;
+    u64 cost;
+
+    samples = now->samples - last->samples;
+    if (!samples)
+        return false;
+
+    runs = now->runs - last->runs;
+    rejects = now->rejects - last->rejects;
+    cost = div64_ul(now->cost - last->cost, samples);
+    *score = rejects ? div64_ul(cost * runs, rejects) : U64_MAX;
+
+    return true;
+}
+
+static void
+filter_sort(struct work_struct *work)
+{
+    struct filter_window now[FILTER_NR];
+    enum hook_filter order[FILTER_NR], sorted[FILTER_NR], stage;
+    bool measured[FILTER_NR];
+    u64 score[FILTER_NR];
+    unsigned long packed;
+    unsigned int index, pos, count;
+
+    filter_sum(now);
+
+    packed = READ_ONCE(filter_order);
+    for (index = count = 0; index < FILTER_NR; ++index) {
+        stage = packed & (BIT(FILTER_ORDER_SHIFT) - 1);
+        packed >>= FILTER_ORDER_SHIFT;
+        order[index] = stage;
+
+        measured[index] = filter_score(&now[stage], &filter_last[stage],
+                                       &score[stage]);
+        if (!measured[index])
+            continue;
+
+        for (pos = count++; pos && score[sorted[pos - 1]] > score[stage]; --pos)
+            sorted[pos] = sorted[pos - 1];
+        sorted[pos] = stage;
+    }
+
+    /* Measured stages take the slots they held between themselves. */
+    for (index = count = 0; index < FILTER_NR; ++index) {
+        if (measured[index])
+            order[index] = sorted[count++];
+    }
+
+    packed = 0;
+    for (index = FILTER_NR; index--;)
+        packed = packed << FILTER_ORDER_SHIFT | order[index];
+
+    WRITE_ONCE(filter_order, packed);
+    memcpy(filter_last, now, sizeof(now));
+    schedule_delayed_work(&filter_work, FILTER_SORT_PERIOD);
+}
+
+static void
+filter_init(void)
+{
+    unsigned long packed;
+    unsigned int stage;
+
+    packed = 0;
+    for (stage = FILTER_NR; stage--;)
+        packed = packed << FILTER_ORDER_SHIFT | stage;
+
+    filter_order = packed;
+    schedule_delayed_work(&filter_work, FILTER_SORT_PERIOD);
+}
+
+int
+lksu_hooks_filters_show(struct seq_file *seq, void *val)
+{
+    struct filter_window total[FILTER_NR];
+    unsigned long packed;
+    enum hook_filter stage;
+    unsigned int index;
+
+    filter_sum(total);
+    packed = READ_ONCE(filter_order);
+
+    seq_puts(seq, "stage\truns\trejects\tns\n");
+    for (index = 0; index < FILTER_NR; ++index) {
+        stage = packed & (BIT(FILTER_ORDER_SHIFT) - 1);
+        packed >>= FILTER_ORDER_SHIFT;
+
+        seq_printf(seq, "%s\t%lu\t%lu\t%lu\n", filter_names[stage],
+                   total[stage].runs, total[stage].rejects,
+                   total[stage].samples ?
+                   total[stage].cost / total[stage].samples : 0);
+    }
+
+    return 0;
+}
+
+/*
+ * Overlayfs repeats open and getattr on the real inode of a layer,
+ * with the credentials of the mounter. Rules match on the overlay
+ * path, so the verdict of a full check on an overlay dentry arms a per
+ * cpu slot, keyed by task and real inode, and answers the one nested
+ * call that follows instead of formatting the layer path again. Only
+ * overlay checks arm it and the first match disarms it, so other
+ * override_creds() users never see a verdict that isn't theirs. The
+ * overlay itself is always checked as well.
+ */
+struct ovl_verdict {
+    const struct task_struct *task;
+    const struct inode *real;
+    bool hidden;
+};
+
+static DEFINE_PER_CPU(struct ovl_verdict, ovl_verdict);
+
+static inline bool
+hook_ovl_nested(const struct inode *inode, bool *hidden)
+{
+    struct ovl_verdict *verdict;
+    bool nested;
+
+    /* Overlays call down with overridden credentials, after arming. */
+    if (likely(current_cred() == current_real_cred()) ||
+        likely(this_cpu_read(ovl_verdict.task) != current))
+        return false;
+
+    verdict = get_cpu_ptr(&ovl_verdict);
+    nested = verdict->task == current && verdict->real == inode;
+    if (nested) {
+        *hidden = verdict->hidden;
+        verdict->task = NULL;
+    }
+    put_cpu_ptr(&ovl_verdict);
+
+    return nested;
+}
+
+static void
+hook_ovl_record(struct dentry *dentry, bool hidden)
+{
+    struct ovl_verdict *verdict;
+    struct inode *real;
+
+    if (likely(dentry->d_sb->s_magic != OVERLAYFS_SUPER_MAGIC))
+        return;
+
+    real = d_real_inode(dentry);
+    verdict = get_cpu_ptr(&ovl_verdict);
+    verdict->task = current;
+    verdict->real = real;
+    verdict->hidden = hidden;
+    put_cpu_ptr(&ovl_verdict);
+}
+
 static int
 hook_file_open(struct file *file)
 {
     bool hidden;
     int retval;
 
-    if (hook_whitelist())
+    if (hook_ovl_nested(file_inode(file), &hidden))
+        return hidden ? -ENOENT : 0;
+
+    if (hook_prefilter(file_inode(file)))
         return 0;
 
     retval = lksu_hidden_file(file, &hidden);
     if (unlikely(retval))
         return retval;
 
+    hook_ovl_record(file->f_path.dentry, hidden);
     if (hidden)
         return -ENOENT;
 
-    if (file->f_flags & O_DIRECTORY)
+    if (IS_ENABLED(CONFIG_LKSU_HIDE_DIRENT) && (file->f_flags & O_DIRECTORY))
         return lksu_hidden_dirent(file);
 
     return 0;
 }
 
-static int
+static int __maybe_unused
 hook_inode_getattr(const struct path *path)
 {
     bool hidden;
     int retval;
 
-    if (hook_whitelist())
+    if (hook_ovl_nested(d_backing_inode(path->dentry), &hidden))
+        return hidden ? -ENOENT : 0;
+
+    if (hook_prefilter(d_backing_inode(path->dentry)))
         return 0;
 
     retval = lksu_hidden_path(path, &hidden);
     if (unlikely(retval))
         return retval;
 
+    hook_ovl_record(path->dentry, hidden);
     return hidden ? -ENOENT : 0;
 }
 
@@ -91,7 +405,8 @@ hook_inode_permission(struct inode *inode)
     bool hidden;
     int retval;
 
-    if (hook_whitelist())
+    /* Overlays check the real inode first here, nothing to answer. */
+    if (hook_prefilter(inode))
         return 0;
 
     retval = lksu_hidden_inode(inode, &hidden);
@@ -101,6 +416,75 @@ hook_inode_permission(struct inode *inode)
     return hidden ? -ENOENT : 0;
 }
 
+static void __maybe_unused
+hook_task_free(struct task_struct *task)
+{
+    lksu_pid_task_free(task);
+    if (IS_ENABLED(CONFIG_LKSU_WHITELIST_EXE))
+        lksu_exe_task_free(task);
+}
+
+static void __maybe_unused
+hook_task_alloc(struct task_struct *task)
+{
+    lksu_exe_task_alloc(task);
+}
+
+static void __maybe_unused
+hook_bprm_committed_creds(const struct linux_binprm *bprm)
+{
+    lksu_exe_exec(bprm);
+}
+
+static void __maybe_unused
+hook_d_instantiate(struct dentry *dentry, struct inode *inode)
+{
+    lksu_mark_instantiate(dentry, inode);
+}
+
+static void __maybe_unused
+hook_inode_free(struct inode *inode)
+{
+    lksu_mark_inode_free(inode);
+}
+
+/*
+ * A rename whose rules could not be copied would show a hidden file
+ * under its new name, backends able to refuse it return the error.
+ * Sealed tables never follow renames.
+ */
+static int __maybe_unused
+hook_inode_rename(struct dentry *old_dentry, struct dentry *new_dentry)
+{
+    int retval;
+
+    retval = lksu_hidden_rename(old_dentry, new_dentry);
+    if (retval == -EROFS)
+        retval = 0;
+
+    if (unlikely(retval)) {
+        pr_warn("failed to follow rename: %d\n", retval);
+        return retval;
+    }
+
+    lksu_mark_rename(old_dentry, new_dentry);
+    return 0;
+}
+
+static void
+hook_mark_file(const char *name, bool hidden)
+{
+    int retval;
+
+    if (!READ_ONCE(lksu_marks_enabled))
+        return;
+
+    retval = lksu_mark_watch(name, hidden);
+    if (retval)
+        pr_warn("failed to %s mark of %s: %d\n",
+                hidden ? "set" : "clear", name, retval);
+}
+
 static const char *
 hook_copy_path(const char __user *name)
 {
@@ -120,15 +504,103 @@ hook_copy_path(const char __user *name)
     return buffer;
 }
 
+static struct mnt_namespace *
+hook_task_mnt_ns(struct task_struct *task)
+{
+    struct mnt_namespace *mnt_ns;
+
+    mnt_ns = NULL;
+    task_lock(task);
+    if (task->nsproxy)
+        mnt_ns = task->nsproxy->mnt_ns;
+    task_unlock(task);
+
+    return mnt_ns;
+}
+
+/*
+ * struct mnt_namespace is private to fs/, references go through the
+ * nsfs operations, which aren't exported to modules and are looked up
+ * once at init instead.
+ */
+static const struct proc_ns_operations *hook_mntns_ops;
+
+static int __init
+hook_mntns_init(void)
+{
+#ifndef MODULE
+    hook_mntns_ops = &mntns_operations;
+#elif defined(CONFIG_KPROBES)
+    unsigned long (*lookup)(const char *name);
+    struct kprobe probe = {
+        .symbol_name = "kallsyms_lookup_name",
+    };
+
+    if (register_kprobe(&probe))
+        return -ENOENT;
+
+    lookup = (void *)probe.addr;
+    unregister_kprobe(&probe);
+    hook_mntns_ops = (void *)lookup("mntns_operations");
+#endif
+
+    return hook_mntns_ops ? 0 : -ENOENT;
+}
+
+/*
+ * Rulesets only keep the namespace as a key, @pin gets a reference
+ * to it for the ruleset to hold. The namespace is read again after
+ * taking it, so a task moving in between is not pinned with the
+ * wrong one.
+ */
+static struct mnt_namespace *
+hook_mnt_ns(pid_t nr, struct ns_common **pin)
+{
+    struct mnt_namespace *mnt_ns;
+    struct task_struct *task;
+    struct pid *pid;
+
+    if (nr)
+        pid = find_get_pid(nr);
+    else
+        pid = get_task_pid(current, PIDTYPE_PID);
+
+    task = get_pid_task(pid, PIDTYPE_PID);
+    put_pid(pid);
+    if (!task)
+        return NULL;
+
+    mnt_ns = hook_task_mnt_ns(task);
+    if (!mnt_ns || !pin)
+        goto finish;
+
+    *pin = hook_mntns_ops->get(task);
+    if (!*pin) {
+        mnt_ns = NULL;
+        goto finish;
+    }
+
+    if (hook_task_mnt_ns(task) != mnt_ns) {
+        hook_mntns_ops->put(*pin);
+        mnt_ns = NULL;
+    }
+
+finish:
+    put_task_struct(task);
+    return mnt_ns;
+}
+
 static bool
 hook_control(int *retptr, struct lksu_message __user *message)
 {
     struct lksu_message msg;
     unsigned long length;
+    const char *path;
     bool verify;
     int retval;
 
     verify = false;
+    path = NULL;
     retval = 0;
 
     if (unlikely(!message)) {
@@ -160,51 +632,61 @@ hook_control(int *retptr, struct lksu_message __user *message)
             break;
 
         case LKSU_FLUSH:
+            if (lksu_table_sealed()) {
+                retval = -EROFS;
+                break;
+            }
+
             pr_notice("flush rules\n");
             lksu_token_flush();
             lksu_table_flush();
+            lksu_pids_flush();
+            lksu_marks_flush();
+            lksu_cgroups_flush();
+            lksu_exes_flush();
             break;
 
-        case LKSU_GLOBAL_HIDDEN_ADD: {
-            const char *hidden;
-
-            hidden = hook_copy_path((void __user *)msg.args.g_hidden);
-            if (unlikely(!hidden)) {
+        case LKSU_GLOBAL_HIDDEN_ADD:
+            path = hook_copy_path((void __user *)msg.args.g_hidden);
+            if (unlikely(!path)) {
                 retval = -ENOMEM;
                 break;
             }
 
-            pr_notice("global file add: %s\n", hidden);
-            retval = lksu_table_gfile_add(hidden);
-            __putname(hidden);
+            pr_debug("global file add: %s\n", path);
+            retval = lksu_table_gfile_add(path);
+            if (!retval || retval == -EALREADY)
+                hook_mark_file(path, true);
             break;
-        }
 
-        case LKSU_GLOBAL_HIDDEN_REMOVE: {
-            const char *hidden;
-
-            hidden = hook_copy_path((void __user *)msg.args.g_hidden);
-            if (unlikely(!hidden)) {
+        case LKSU_GLOBAL_HIDDEN_REMOVE:
+            path = hook_copy_path((void __user *)msg.args.g_hidden);
+            if (unlikely(!path)) {
                 retval = -ENOMEM;
                 break;
             }
 
-            pr_notice("global file remove: %s\n", hidden);
-            retval = lksu_table_gfile_remove(hidden);
-            __putname(hidden);
+            pr_debug("global file remove: %s\n", path);
+            retval = lksu_table_gfile_remove(path);
+            if (!retval || retval == -ENOENT)
+                hook_mark_file(path, false);
             break;
-        }
 
         case LKSU_GLOBAL_UID_ADD: {
             kuid_t kuid;
 
+            if (!IS_ENABLED(CONFIG_LKSU_WHITELIST_UID)) {
+                retval = -EOPNOTSUPP;
+                break;
+            }
+
             kuid = make_kuid(current_user_ns(), msg.args.g_uid);
             if (!uid_valid(kuid)) {
                 retval = -EINVAL;
                 break;
             }
 
-            pr_notice("global uid add: %u\n", __kuid_val(kuid));
+            pr_debug("global uid add: %u\n", __kuid_val(kuid));
             retval = lksu_table_guid_add(kuid);
             break;
         }
@@ -212,27 +694,228 @@ hook_control(int *retptr, struct lksu_message __user *message)
         case LKSU_GLOBAL_UID_REMOVE: {
             kuid_t kuid;
 
+            if (!IS_ENABLED(CONFIG_LKSU_WHITELIST_UID)) {
+                retval = -EOPNOTSUPP;
+                break;
+            }
+
             kuid = make_kuid(current_user_ns(), msg.args.g_uid);
             if (!uid_valid(kuid)) {
                 retval = -EINVAL;
                 break;
             }
 
-            pr_notice("global uid remove: %u\n", __kuid_val(kuid));
+            pr_debug("global uid remove: %u\n", __kuid_val(kuid));
             retval = lksu_table_guid_remove(kuid);
             break;
         }
 
+        case LKSU_GLOBAL_CGROUP_ADD:
+        case LKSU_GLOBAL_CGROUP_REMOVE:
+            if (!IS_ENABLED(CONFIG_LKSU_WHITELIST_CGROUP)) {
+                retval = -EOPNOTSUPP;
+                break;
+            }
+
+            if (lksu_table_sealed()) {
+                retval = -EROFS;
+                break;
+            }
+
+            if (msg.func == LKSU_GLOBAL_CGROUP_ADD) {
+                pr_debug("global cgroup add: %llu\n", msg.args.g_cgroup);
+                retval = lksu_cgroup_add(msg.args.g_cgroup);
+            } else {
+                pr_debug("global cgroup remove: %llu\n", msg.args.g_cgroup);
+                retval = lksu_cgroup_remove(msg.args.g_cgroup);
+            }
+            break;
+
+        case LKSU_GLOBAL_EXE_ADD:
+        case LKSU_GLOBAL_EXE_REMOVE:
+            if (!IS_ENABLED(CONFIG_LKSU_WHITELIST_EXE)) {
+                retval = -EOPNOTSUPP;
+                break;
+            }
+
+            if (lksu_table_sealed()) {
+                retval = -EROFS;
+                break;
+            }
+
+            path = hook_copy_path((void __user *)msg.args.g_exe);
+            if (unlikely(!path)) {
+                retval = -ENOMEM;
+                break;
+            }
+
+            if (msg.func == LKSU_GLOBAL_EXE_ADD) {
+                pr_debug("global exe add: %s\n", path);
+                retval = lksu_exe_add(path);
+            } else {
+                pr_debug("global exe remove: %s\n", path);
+                retval = lksu_exe_remove(path);
+            }
+            break;
+
         case LKSU_TOKEN_ADD:
-            pr_notice("token add: %.*s\n", LKSU_TOKEN_LEN, msg.args.token);
+            pr_debug("token add: %.*s\n", LKSU_TOKEN_LEN, msg.args.token);
             retval = lksu_token_add(msg.args.token);
             break;
 
         case LKSU_TOKEN_REMOVE:
-            pr_notice("token remove: %.*s\n", LKSU_TOKEN_LEN, msg.args.token);
+            pr_debug("token remove: %.*s\n", LKSU_TOKEN_LEN, msg.args.token);
             retval = lksu_token_remove(msg.args.token);
             break;
 
+        case LKSU_NS_HIDDEN_ADD: {
+            struct mnt_namespace *mnt_ns;
+            struct ns_common *pin;
+
+            if (unlikely(!hook_mntns_ops)) {
+                retval = -EOPNOTSUPP;
+                break;
+            }
+
+            path = hook_copy_path((void __user *)msg.args.ns.hidden);
+            if (unlikely(!path)) {
+                retval = -ENOMEM;
+                break;
+            }
+
+            mnt_ns = hook_mnt_ns(msg.args.ns.pid, &pin);
+            if (unlikely(!mnt_ns)) {
+                retval = -ESRCH;
+                break;
+            }
+
+            pr_debug("namespace %d file add: %s\n", msg.args.ns.pid, path);
+            retval = lksu_table_nsfile_add(mnt_ns, &pin, path);
+            if (pin)
+                hook_mntns_ops->put(pin);
+            break;
+        }
+
+        case LKSU_NS_HIDDEN_REMOVE: {
+            struct mnt_namespace *mnt_ns;
+
+            mnt_ns = hook_mnt_ns(msg.args.ns.pid, NULL);
+            if (unlikely(!mnt_ns)) {
+                retval = -ESRCH;
+                break;
+            }
+
+            path = hook_copy_path((void __user *)msg.args.ns.hidden);
+            if (unlikely(!path)) {
+                retval = -ENOMEM;
+                break;
+            }
+
+            pr_debug("namespace %d file remove: %s\n", msg.args.ns.pid, path);
+            retval = lksu_table_nsfile_remove(mnt_ns, path);
+            break;
+        }
+
+        case LKSU_NS_FLUSH: {
+            struct mnt_namespace *mnt_ns;
+
+            if (lksu_table_sealed()) {
+                retval = -EROFS;
+                break;
+            }
+
+            mnt_ns = hook_mnt_ns(msg.args.ns.pid, NULL);
+            if (unlikely(!mnt_ns)) {
+                retval = -ESRCH;
+                break;
+            }
+
+            pr_notice("namespace %d flush rules\n", msg.args.ns.pid);
+            lksu_table_ns_flush(mnt_ns);
+            break;
+        }
+
+        case LKSU_UID_HIDDEN_ADD:
+        case LKSU_UID_HIDDEN_REMOVE: {
+            kuid_t first, last;
+
+            first = make_kuid(current_user_ns(), msg.args.uid.first);
+            last = make_kuid(current_user_ns(), msg.args.uid.last);
+            if (!uid_valid(first) || !uid_valid(last)) {
+                retval = -EINVAL;
+                break;
+            }
+
+            path = hook_copy_path((void __user *)msg.args.uid.hidden);
+            if (unlikely(!path)) {
+                retval = -ENOMEM;
+                break;
+            }
+
+            if (msg.func == LKSU_UID_HIDDEN_ADD) {
+                pr_debug("uid %u-%u file add: %s\n", __kuid_val(first),
+                         __kuid_val(last), path);
+                retval = lksu_table_uidfile_add(first, last, path);
+            } else {
+                pr_debug("uid %u-%u file remove: %s\n", __kuid_val(first),
+                         __kuid_val(last), path);
+                retval = lksu_table_uidfile_remove(first, last, path);
+            }
+
+            break;
+        }
+
+        case LKSU_TRACE_START:
+            pr_notice("trace start: %u bytes\n", msg.args.trace_size);
+            retval = lksu_trace_start(msg.args.trace_size);
+            break;
+
+        case LKSU_TRACE_STOP:
+            pr_notice("trace stop\n");
+            lksu_trace_stop();
+            break;
+
+        case LKSU_PID_HIDDEN_ADD:
+            pr_debug("pid hidden add: %d\n", msg.args.pid);
+            retval = lksu_pid_add(msg.args.pid);
+            break;
+
+        case LKSU_PID_HIDDEN_REMOVE:
+            pr_debug("pid hidden remove: %d\n", msg.args.pid);
+            retval = lksu_pid_remove(msg.args.pid);
+            break;
+
+        case LKSU_XATTR_ENABLE:
+#ifdef CONFIG_LKSU_HOOK_LIVEPATCH
+            retval = -EOPNOTSUPP;
+#else
+            pr_notice("xattr marks enable\n");
+            retval = lksu_marks_enable(true);
+#endif
+            break;
+
+        case LKSU_XATTR_DISABLE:
+            pr_notice("xattr marks disable\n");
+            lksu_marks_enable(false);
+            break;
+
+        case LKSU_SEAL:
+            pr_notice("seal rules\n");
+            retval = lksu_table_seal();
+            if (retval)
+                break;
+
+            retval = lksu_token_seal();
+            if (retval)
+                lksu_table_unseal();
+            break;
+
+        case LKSU_UNSEAL:
+            pr_notice("unseal rules\n");
+            lksu_token_unseal();
+            lksu_table_unseal();
+            break;
+
         default:
             retval = -EINVAL;
             break;
@@ -241,15 +924,21 @@ hook_control(int *retptr, struct lksu_message __user *message)
 finish:
     *retptr = retval;
 
-    if (retval) {
+    if (verify)
+        lksu_event_control(msg.func, retval, path);
+    else
+        lksu_event_auth(retval);
+
+    if (path)
+        __putname(path);
+
+    if (retval && verify) {
 #if LINUX_VERSION_CODE >= KERNEL_VERSION(6, 7, 0)
         const char *ename;
         ename = errname(retval) ?: "EUNKNOW";
-        pr_warn("illegal operation: %s (%s)\n", ename,
-                verify ? "verified" : "non-validated");
+        pr_warn_ratelimited("illegal operation: %s\n", ename);
 #else
-        pr_warn("illegal operation: %d (%s)\n", retval,
-                verify ? "verified" : "non-validated");
+        pr_warn_ratelimited("illegal operation: %d\n", retval);
 #endif
     }
 
@@ -269,18 +958,32 @@ finish:
 int __init
 lksu_hooks_init(void)
 {
+    int retval;
+
+    filter_init();
+
+    if (hook_mntns_init())
+        pr_warn("mount namespace operations not found, namespace rules disabled\n");
+
 #if defined(CONFIG_LKSU_HOOK_LSM)
-    return hooks_lsm_init();
+    retval = hooks_lsm_init();
 #elif defined(CONFIG_LKSU_HOOK_LIVEPATCH)
-    return hooks_livepatch_init();
+    retval = hooks_livepatch_init();
 #else
-    return hooks_kprobe_init();
+    retval = hooks_kprobe_init();
 #endif
+
+    if (retval)
+        cancel_delayed_work_sync(&filter_work);
+
+    return retval;
 }
 
 void
 lksu_hooks_exit(void)
 {
+    cancel_delayed_work_sync(&filter_work);
+
 #if defined(CONFIG_LKSU_HOOK_LSM)
     hooks_lsm_exit();
 #elif defined(CONFIG_LKSU_HOOK_LIVEPATCH)
@@ -8,6 +8,11 @@
 
 #include <linux/module.h>
 
+struct seq_file;
+
+extern int
+lksu_hooks_filters_show(struct seq_file *seq, void *val);
+
 extern int
 lksu_hooks_init(void);
 
@@ -18,7 +18,6 @@
 #endif
 
 #define LKSU_TOKEN_LEN 36
-#define LKSU_DEBUG 1
 
 enum lksu_func {
     LKSU_ENABLE = 0,
@@ -32,9 +31,101 @@ enum lksu_func {
 
     LKSU_TOKEN_ADD,
     LKSU_TOKEN_REMOVE,
+
+    LKSU_NS_HIDDEN_ADD,
+    LKSU_NS_HIDDEN_REMOVE,
+    LKSU_NS_FLUSH,
+
+    LKSU_UID_HIDDEN_ADD,
+    LKSU_UID_HIDDEN_REMOVE,
+
+    LKSU_TRACE_START,
+    LKSU_TRACE_STOP,
+
+    LKSU_SEAL,
+    LKSU_UNSEAL,
+
+    LKSU_PID_HIDDEN_ADD,
+    LKSU_PID_HIDDEN_REMOVE,
+
+    LKSU_XATTR_ENABLE,
+    LKSU_XATTR_DISABLE,
+
+    LKSU_GLOBAL_CGROUP_ADD,
+    LKSU_GLOBAL_CGROUP_REMOVE,
+
+    LKSU_GLOBAL_EXE_ADD,
+    LKSU_GLOBAL_EXE_REMOVE,
     LKSU_FUNC_MAX_NR,
 };
 
+enum lksu_trace_hook {
+    LKSU_TRACE_FILE = 0,
+    LKSU_TRACE_PATH,
+    LKSU_TRACE_INODE,
+    LKSU_TRACE_DIRENT,
+    LKSU_TRACE_HOOK_NR,
+};
+
+/*
+ * Records read from /proc/lksu/trace, each followed by @size minus
+ * the header bytes of path without terminator. Every cpu is drained
+ * in turn, so records are ordered per cpu and not globally.
+ */
+struct lksu_trace_event {
+    __u16 size;
+    __u8 hook;
+    __u8 verdict;
+    __kernel_uid_t uid;
+    __u32 latency;
+    __u32 cpu;
+    __u64 time;
+    char name[];
+};
+
+enum lksu_dump_type {
+    LKSU_DUMP_FILE = 0,
+    LKSU_DUMP_UID,
+};
+
+/*
+ * Records read from /proc/lksu/dump, global hidden files first and
+ * whitelist uids second. File records carry @size minus the header
+ * bytes of path without terminator, uid records only the header.
+ */
+struct lksu_dump_record {
+    __u16 size;
+    __u8 type;
+    __u8 reserved;
+    __kernel_uid_t uid;
+    char name[];
+};
+
+enum lksu_event_type {
+    LKSU_EVENT_DENY = 0,
+    LKSU_EVENT_CONTROL,
+    LKSU_EVENT_AUTH,
+    LKSU_EVENT_LOST,
+};
+
+/*
+ * Records read from /proc/lksu/events, each followed by @size minus
+ * the header bytes of path without terminator. Denials carry the
+ * lksu_trace_hook in @func and no path when they came from a mark or
+ * a hidden pid, control operations carry the lksu_func. Lost records
+ * report in @retval how many events were dropped since the last one.
+ */
+struct lksu_event {
+    __u16 size;
+    __u8 type;
+    __u8 func;
+    __s32 retval;
+    __kernel_uid_t uid;
+    __kernel_pid_t pid;
+    __u64 time;
+    char name[];
+};
+
 struct lksu_message {
     char token[LKSU_TOKEN_LEN];
     enum lksu_func func;
@@ -48,6 +139,31 @@ struct lksu_message {
 
         /* LKSU_GLOBAL_UID_* */
         __kernel_uid_t g_uid;
+
+        /* LKSU_NS_* */
+        struct {
+            __kernel_pid_t pid;
+            const char *hidden;
+        } ns;
+
+        /* LKSU_UID_HIDDEN_* */
+        struct {
+            __kernel_uid_t first;
+            __kernel_uid_t last;
+            const char *hidden;
+        } uid;
+
+        /* LKSU_TRACE_START */
+        __u32 trace_size;
+
+        /* LKSU_PID_HIDDEN_* */
+        __kernel_pid_t pid;
+
+        /* LKSU_GLOBAL_CGROUP_*, cgroup v2 id */
+        __u64 g_cgroup;
+
+        /* LKSU_GLOBAL_EXE_*, path of the executable */
+        const char *g_exe;
     } args;
 };
 
@@ -12,6 +12,12 @@
 #include "tables.h"
 #include "token.h"
 #include "procfs.h"
+#include "trace.h"
+#include "pids.h"
+#include "marks.h"
+#include "events.h"
+#include "cgroups.h"
+#include "exes.h"
 
 #include <linux/module.h>
 #include <linux/printk.h>
@@ -39,10 +45,22 @@ lksu_init(void)
         goto free_tables;
     }
 
+    retval = lksu_marks_init();
+    if (retval) {
+        pr_crit("failed to init marks: %d\n", retval);
+        goto free_hidden;
+    }
+
+    retval = lksu_events_init();
+    if (retval) {
+        pr_crit("failed to init events: %d\n", retval);
+        goto free_marks;
+    }
+
     retval = lksu_hooks_init();
     if (retval) {
         pr_crit("failed to init hooks: %d\n", retval);
-        goto free_hidden;
+        goto free_events;
     }
 
     retval = lksu_procfs_init();
@@ -55,6 +73,10 @@ lksu_init(void)
 
 free_hooks:
     lksu_hooks_exit();
+free_events:
+    lksu_events_exit();
+free_marks:
+    lksu_marks_exit();
 free_hidden:
     lksu_hidden_exit();
 free_tables:
@@ -67,8 +89,15 @@ free_token:
 static __exit void
 lksu_exit(void)
 {
+    lksu_events_shutdown();
     lksu_procfs_exit();
     lksu_hooks_exit();
+    lksu_events_exit();
+    lksu_trace_exit();
+    lksu_pids_flush();
+    lksu_cgroups_flush();
+    lksu_exes_flush();
+    lksu_marks_exit();
     lksu_hidden_exit();
     lksu_tables_exit();
     lksu_token_exit();
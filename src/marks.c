@@ -0,0 +1,704 @@
+/* SPDX-License-Identifier: GPL-2.0-or-later */
+/*
+ * Copyright(c) 2024 John Sanpe <sanpeqf@gmail.com>
+ */
+
+#define MODULE_NAME "lksu-marks"
+#define pr_fmt(fmt) MODULE_NAME ": " fmt
+
+#include "lksu.h"
+#include "marks.h"
+#include "tables.h"
+#include "hidden.h"
+
+#include <linux/module.h>
+#include <linux/fs.h>
+#include <linux/namei.h>
+#include <linux/mount.h>
+#include <linux/xattr.h>
+#include <linux/slab.h>
+#include <linux/hashtable.h>
+#include <linux/stringhash.h>
+#include <linux/workqueue.h>
+#include <linux/mutex.h>
+#include <linux/spinlock.h>
+#include <linux/rcupdate.h>
+#include <linux/version.h>
+#include <linux/printk.h>
+
+#define MARKS_HASH_BITS 10
+#define WATCH_HASH_BITS 8
+
+/*
+ * Hidden files persisted as a security.lksu xattr. The hooks are
+ * registered after the LSM blobs were sized, so the mark is cached in
+ * a set keyed by superblock and inode number instead of in the inode
+ * security blob, readdir only knows the number. It is filled when a
+ * dentry is instantiated, and for the ones already cached on the root
+ * filesystem when the mode is enabled, and pruned when the inode is
+ * freed. A check is one hash probe without any path string.
+ *
+ * Every directory a marked inode was seen in gets its own mark, and
+ * the directories are counted in a second set. Only those are wrapped
+ * for readdir, opening any other directory costs a single probe.
+ */
+struct lksu_mark {
+    struct hlist_node hash;
+    const struct super_block *sb;
+    u64 ino;
+    u64 dir;
+    struct rcu_head rcu;
+};
+
+struct lksu_mark_dir {
+    struct hlist_node hash;
+    const struct super_block *sb;
+    u64 ino;
+    unsigned int count;
+    struct rcu_head rcu;
+};
+
+/*
+ * Rules are watched by basename so that files created, renamed or
+ * linked after their rule was added get bound as they appear. Only a
+ * basename hit builds the path to compare against the full rule, the
+ * xattr is then written from a worker outside the vfs locks.
+ *
+ * Instantiation has no vfsmount, the path is relative to the root of
+ * the superblock. It only equals the absolute path on the filesystem
+ * mounted as the system root, dentries of any other superblock are
+ * never bound by a watch.
+ */
+struct lksu_watch {
+    struct hlist_node hash;
+    const char *base;
+    size_t baselen;
+    struct rcu_head rcu;
+    char name[];
+};
+
+struct mark_persist {
+    struct work_struct work;
+    struct path path;
+};
+
+bool lksu_marks_enabled __read_mostly;
+static unsigned int mark_count;
+static DEFINE_HASHTABLE(mark_hash, MARKS_HASH_BITS);
+static DEFINE_HASHTABLE(mark_dir_hash, MARKS_HASH_BITS);
+static DEFINE_SPINLOCK(mark_lock);
+
+static unsigned int watch_count;
+static DEFINE_HASHTABLE(watch_hash, WATCH_HASH_BITS);
+static DEFINE_MUTEX(watch_mutex);
+static struct workqueue_struct *mark_wq;
+
+static inline unsigned long
+mark_key(const struct super_block *sb, u64 ino)
+{
+    return (unsigned long)sb ^ (unsigned long)ino;
+}
+
+static struct lksu_mark *
+mark_lookup(const struct super_block *sb, u64 ino)
+{
+    struct lksu_mark *mark;
+
+    hash_for_each_possible_rcu(mark_hash, mark, hash, mark_key(sb, ino)) {
+        if (mark->ino == ino && mark->sb == sb)
+            return mark;
+    }
+
+    return NULL;
+}
+
+static struct lksu_mark *
+mark_find(const struct super_block *sb, u64 ino, u64 dir)
+{
+    struct lksu_mark *mark;
+
+    hash_for_each_possible(mark_hash, mark, hash, mark_key(sb, ino)) {
+        if (mark->ino == ino && mark->sb == sb && mark->dir == dir)
+            return mark;
+    }
+
+    return NULL;
+}
+
+static struct lksu_mark_dir *
+mark_dir_lookup(const struct super_block *sb, u64 ino)
+{
+    struct lksu_mark_dir *dir;
+
+    hash_for_each_possible_rcu(mark_dir_hash, dir, hash, mark_key(sb, ino)) {
+        if (dir->ino == ino && dir->sb == sb)
+            return dir;
+    }
+
+    return NULL;
+}
+
+static u64
+mark_parent(struct dentry *dentry)
+{
+    struct inode *dir;
+    u64 ino;
+
+    rcu_read_lock();
+    dir = d_inode_rcu(READ_ONCE(dentry->d_parent));
+    ino = dir ? dir->i_ino : 0;
+    rcu_read_unlock();
+
+    return ino;
+}
+
+static void
+mark_release(struct lksu_mark *mark)
+{
+    struct lksu_mark_dir *dir;
+
+    lockdep_assert_held(&mark_lock);
+    dir = mark_dir_lookup(mark->sb, mark->dir);
+    if (dir && !--dir->count) {
+        hash_del_rcu(&dir->hash);
+        kfree_rcu(dir, rcu);
+    }
+
+    hash_del_rcu(&mark->hash);
+    WRITE_ONCE(mark_count, mark_count - 1);
+    kfree_rcu(mark, rcu);
+}
+
+/* Marks @inode as seen through @dentry, once per parent directory. */
+static void
+mark_insert(struct dentry *dentry, const struct inode *inode, gfp_t gfp)
+{
+    struct lksu_mark_dir *dir, *exist;
+    struct lksu_mark *mark;
+    unsigned long flags;
+
+    mark = kmalloc(sizeof(*mark), gfp);
+    dir = kmalloc(sizeof(*dir), gfp);
+    if (unlikely(!mark || !dir))
+        goto failed;
+
+    mark->sb = inode->i_sb;
+    mark->ino = inode->i_ino;
+    mark->dir = mark_parent(dentry);
+
+    spin_lock_irqsave(&mark_lock, flags);
+    if (mark_find(mark->sb, mark->ino, mark->dir)) {
+        spin_unlock_irqrestore(&mark_lock, flags);
+        goto failed;
+    }
+
+    exist = mark_dir_lookup(mark->sb, mark->dir);
+    if (!exist) {
+        dir->sb = mark->sb;
+        dir->ino = mark->dir;
+        dir->count = 0;
+        hash_add_rcu(mark_dir_hash, &dir->hash, mark_key(dir->sb, dir->ino));
+        exist = dir;
+        dir = NULL;
+    }
+
+    exist->count++;
+    hash_add_rcu(mark_hash, &mark->hash, mark_key(mark->sb, mark->ino));
+    WRITE_ONCE(mark_count, mark_count + 1);
+    spin_unlock_irqrestore(&mark_lock, flags);
+
+    kfree(dir);
+    return;
+
+failed:
+    kfree(dir);
+    kfree(mark);
+}
+
+static void
+mark_delete(const struct inode *inode)
+{
+    struct lksu_mark *mark;
+    struct hlist_node *tmp;
+    unsigned long flags;
+
+    spin_lock_irqsave(&mark_lock, flags);
+    hash_for_each_possible_safe(mark_hash, mark, tmp, hash,
+                                mark_key(inode->i_sb, inode->i_ino)) {
+        if (mark->ino == inode->i_ino && mark->sb == inode->i_sb)
+            mark_release(mark);
+    }
+    spin_unlock_irqrestore(&mark_lock, flags);
+}
+
+bool
+lksu_mark_check(const struct inode *inode)
+{
+    if (!READ_ONCE(mark_count) || !inode)
+        return false;
+
+    return lksu_mark_check_ino(inode->i_sb, inode->i_ino);
+}
+
+bool
+lksu_mark_check_ino(const struct super_block *sb, u64 ino)
+{
+    bool marked;
+
+    if (!READ_ONCE(mark_count))
+        return false;
+
+    rcu_read_lock();
+    marked = !!mark_lookup(sb, ino);
+    rcu_read_unlock();
+
+    return marked;
+}
+
+bool
+lksu_mark_check_dir(const struct inode *dir)
+{
+    bool marked;
+
+    if (!READ_ONCE(mark_count) || !dir)
+        return false;
+
+    rcu_read_lock();
+    marked = !!mark_dir_lookup(dir->i_sb, dir->i_ino);
+    rcu_read_unlock();
+
+    return marked;
+}
+
+static int
+mark_xattr_set(struct dentry *dentry)
+{
+    static const char value[] = "1";
+
+#if LINUX_VERSION_CODE >= KERNEL_VERSION(6, 3, 0)
+    return vfs_setxattr(&nop_mnt_idmap, dentry, LKSU_XATTR_NAME,
+                        value, sizeof(value) - 1, 0);
+#elif LINUX_VERSION_CODE >= KERNEL_VERSION(5, 12, 0)
+    return vfs_setxattr(&init_user_ns, dentry, LKSU_XATTR_NAME,
+                        value, sizeof(value) - 1, 0);
+#else
+    return vfs_setxattr(dentry, LKSU_XATTR_NAME,
+                        value, sizeof(value) - 1, 0);
+#endif
+}
+
+static int
+mark_xattr_remove(struct dentry *dentry)
+{
+#if LINUX_VERSION_CODE >= KERNEL_VERSION(6, 3, 0)
+    return vfs_removexattr(&nop_mnt_idmap, dentry, LKSU_XATTR_NAME);
+#elif LINUX_VERSION_CODE >= KERNEL_VERSION(5, 12, 0)
+    return vfs_removexattr(&init_user_ns, dentry, LKSU_XATTR_NAME);
+#else
+    return vfs_removexattr(dentry, LKSU_XATTR_NAME);
+#endif
+}
+
+static int
+mark_set(const char *name, bool hidden)
+{
+    struct inode *inode;
+    struct path path;
+    int retval;
+
+    retval = kern_path(name, 0, &path);
+    if (retval)
+        return retval;
+
+    /* Read-only and frozen mounts fail here with -EROFS or wait. */
+    retval = mnt_want_write(path.mnt);
+    if (retval)
+        goto finish;
+
+    inode = d_backing_inode(path.dentry);
+    if (hidden) {
+        /* Filesystems without xattrs still get the cached mark. */
+        retval = mark_xattr_set(path.dentry);
+        if (retval == -EOPNOTSUPP)
+            retval = 0;
+        if (!retval)
+            mark_insert(path.dentry, inode, GFP_KERNEL);
+    } else {
+        retval = mark_xattr_remove(path.dentry);
+        if (retval == -ENODATA)
+            retval = 0;
+        mark_delete(inode);
+    }
+
+    mnt_drop_write(path.mnt);
+finish:
+    path_put(&path);
+    return retval;
+}
+
+static inline unsigned int
+watch_hash_base(const char *base, size_t length)
+{
+    return full_name_hash(NULL, base, length);
+}
+
+static struct lksu_watch *
+watch_lookup(const char *name)
+{
+    struct lksu_watch *watch;
+    const char *base;
+
+    base = kbasename(name);
+    hash_for_each_possible(watch_hash, watch, hash,
+                           watch_hash_base(base, strlen(base))) {
+        if (!strcmp(watch->name, name))
+            return watch;
+    }
+
+    return NULL;
+}
+
+static int
+watch_add(const char *name)
+{
+    struct lksu_watch *watch;
+    size_t length;
+
+    if (watch_lookup(name))
+        return 0;
+
+    length = strlen(name);
+    watch = kmalloc(struct_size(watch, name, length + 1), GFP_KERNEL);
+    if (unlikely(!watch))
+        return -ENOMEM;
+
+    memcpy(watch->name, name, length + 1);
+    watch->base = kbasename(watch->name);
+    watch->baselen = watch->name + length - watch->base;
+
+    hash_add_rcu(watch_hash, &watch->hash,
+                 watch_hash_base(watch->base, watch->baselen));
+    WRITE_ONCE(watch_count, watch_count + 1);
+
+    return 0;
+}
+
+static void
+watch_release(struct lksu_watch *watch)
+{
+    hash_del_rcu(&watch->hash);
+    WRITE_ONCE(watch_count, watch_count - 1);
+    kfree_rcu(watch, rcu);
+}
+
+static bool
+watch_match(struct dentry *dentry)
+{
+    const struct qstr *qname;
+    struct lksu_watch *watch;
+    unsigned int hash;
+    char *buffer, *name;
+    bool matched, hit;
+
+    if (!READ_ONCE(watch_count))
+        return false;
+
+    if (!lksu_hidden_rooted(dentry))
+        return false;
+
+    qname = &dentry->d_name;
+    hash = watch_hash_base(qname->name, qname->len);
+
+    hit = false;
+    rcu_read_lock();
+    hash_for_each_possible_rcu(watch_hash, watch, hash, hash) {
+        if (watch->baselen == qname->len &&
+            !memcmp(watch->base, qname->name, qname->len)) {
+            hit = true;
+            break;
+        }
+    }
+    rcu_read_unlock();
+
+    if (!hit)
+        return false;
+
+    /* Called from filesystem create paths, reclaim must not recurse. */
+    buffer = kmalloc(PATH_MAX, GFP_NOFS);
+    if (unlikely(!buffer))
+        return false;
+
+    matched = false;
+    name = dentry_path_raw(dentry, buffer, PATH_MAX);
+    if (!IS_ERR(name)) {
+        rcu_read_lock();
+        hash_for_each_possible_rcu(watch_hash, watch, hash, hash) {
+            if (!strcmp(watch->name, name)) {
+                matched = true;
+                break;
+            }
+        }
+        rcu_read_unlock();
+    }
+
+    kfree(buffer);
+
+    return matched;
+}
+
+static void
+mark_persist_work(struct work_struct *work)
+{
+    struct mark_persist *persist;
+    struct path *path;
+
+    persist = container_of(work, struct mark_persist, work);
+    path = &persist->path;
+
+    if (!d_unlinked(path->dentry) && !mnt_want_write(path->mnt)) {
+        mark_xattr_set(path->dentry);
+        mnt_drop_write(path->mnt);
+    }
+
+    path_put(path);
+    kfree(persist);
+}
+
+/* The worker writes to the matched dentry itself, never to a lookup. */
+static void
+mark_persist(struct dentry *dentry)
+{
+    struct mark_persist *persist;
+
+    if (!mark_wq)
+        return;
+
+    persist = kmalloc(sizeof(*persist), GFP_NOFS);
+    if (unlikely(!persist))
+        return;
+
+    persist->path.mnt = lksu_hidden_root.mnt;
+    persist->path.dentry = dentry;
+    path_get(&persist->path);
+
+    INIT_WORK(&persist->work, mark_persist_work);
+    queue_work(mark_wq, &persist->work);
+}
+
+/* Binds @inode if @dentry is where a watched rule points to. */
+static void
+mark_bind(struct dentry *dentry, struct inode *inode)
+{
+    if (!watch_match(dentry))
+        return;
+
+    mark_insert(dentry, inode, GFP_NOFS);
+    if (inode->i_opflags & IOP_XATTR)
+        mark_persist(dentry);
+}
+
+static bool
+mark_xattr_read(struct dentry *dentry, struct inode *inode, gfp_t gfp)
+{
+    char value[2];
+    ssize_t length;
+
+    if (!(inode->i_opflags & IOP_XATTR))
+        return false;
+
+    length = __vfs_getxattr(dentry, inode, LKSU_XATTR_NAME,
+                            value, sizeof(value));
+    if (length <= 0)
+        return false;
+
+    mark_insert(dentry, inode, gfp);
+    return true;
+}
+
+void
+lksu_mark_instantiate(struct dentry *dentry, struct inode *inode)
+{
+    if (!READ_ONCE(lksu_marks_enabled) || !inode)
+        return;
+
+    if (!mark_xattr_read(dentry, inode, GFP_NOFS))
+        mark_bind(dentry, inode);
+}
+
+void
+lksu_mark_rename(struct dentry *old_dentry, struct dentry *new_dentry)
+{
+    struct inode *inode;
+
+    inode = d_backing_inode(old_dentry);
+    if (!READ_ONCE(lksu_marks_enabled) || !inode)
+        return;
+
+    /* Marked inodes are listed in the new directory too. */
+    if (lksu_mark_check(inode))
+        mark_insert(new_dentry, inode, GFP_NOFS);
+    else
+        mark_bind(new_dentry, inode);
+}
+
+int
+lksu_mark_watch(const char *name, bool hidden)
+{
+    struct lksu_watch *watch;
+    int retval;
+
+    mutex_lock(&watch_mutex);
+    if (hidden) {
+        retval = watch_add(name);
+    } else {
+        watch = watch_lookup(name);
+        if (watch)
+            watch_release(watch);
+        retval = 0;
+    }
+    mutex_unlock(&watch_mutex);
+
+    if (retval)
+        return retval;
+
+    /* Files not created yet are bound by the watch later on. */
+    retval = mark_set(name, hidden);
+    return retval == -ENOENT ? 0 : retval;
+}
+
+void
+lksu_mark_inode_free(struct inode *inode)
+{
+    if (!READ_ONCE(mark_count))
+        return;
+
+    mark_delete(inode);
+}
+
+static void
+watch_flush(void)
+{
+    struct lksu_watch *watch;
+    struct hlist_node *tmp;
+    unsigned int bkt;
+
+    mutex_lock(&watch_mutex);
+    hash_for_each_safe(watch_hash, bkt, tmp, watch, hash)
+        watch_release(watch);
+    mutex_unlock(&watch_mutex);
+}
+
+/*
+ * Dentries instantiated before the mode was enabled never had their
+ * xattr read, the cached inodes of the root filesystem are walked the
+ * way drop_caches does. Other filesystems are read as their dentries
+ * are instantiated again.
+ */
+static void
+marks_scan(struct super_block *sb)
+{
+    struct inode *inode, *toput;
+    struct dentry *dentry;
+
+    toput = NULL;
+    spin_lock(&sb->s_inode_list_lock);
+    list_for_each_entry(inode, &sb->s_inodes, i_sb_list) {
+        /* Inodes still being set up have no alias to read from yet. */
+        if (!(inode->i_opflags & IOP_XATTR) || !igrab(inode))
+            continue;
+        spin_unlock(&sb->s_inode_list_lock);
+
+        iput(toput);
+        toput = inode;
+
+        dentry = d_find_any_alias(inode);
+        if (dentry) {
+            mark_xattr_read(dentry, inode, GFP_KERNEL);
+            dput(dentry);
+        }
+
+        cond_resched();
+        spin_lock(&sb->s_inode_list_lock);
+    }
+    spin_unlock(&sb->s_inode_list_lock);
+    iput(toput);
+}
+
+/* Enabling binds every global rule already present, or watches it. */
+int
+lksu_marks_enable(bool enable)
+{
+    char *batch, *cursor, *name;
+    size_t length, offset;
+    int retval;
+
+    if (!enable) {
+        WRITE_ONCE(lksu_marks_enabled, false);
+        lksu_marks_flush();
+        return 0;
+    }
+
+    batch = kmalloc(PATH_MAX * 3, GFP_KERNEL);
+    if (unlikely(!batch))
+        return -ENOMEM;
+
+    cursor = batch + PATH_MAX * 2;
+    WRITE_ONCE(lksu_marks_enabled, true);
+
+    if (lksu_hidden_root.dentry)
+        marks_scan(lksu_hidden_root.dentry->d_sb);
+
+    retval = 0;
+    length = lksu_table_gfile_export(NULL, batch, PATH_MAX * 2);
+    while (length && !retval) {
+        for (offset = 0; offset < length; offset += strlen(name) + 1) {
+            name = batch + offset;
+            retval = lksu_mark_watch(name, true);
+            if (retval)
+                break;
+        }
+
+        strscpy(cursor, name, PATH_MAX);
+        length = lksu_table_gfile_export(cursor, batch, PATH_MAX * 2);
+    }
+
+    kfree(batch);
+
+    return retval;
+}
+
+/* Only drops the cache, the xattrs stay on disk for the next boot. */
+void
+lksu_marks_flush(void)
+{
+    struct lksu_mark *mark;
+    struct hlist_node *tmp;
+    unsigned long flags;
+    unsigned int bkt;
+
+    watch_flush();
+
+    spin_lock_irqsave(&mark_lock, flags);
+    hash_for_each_safe(mark_hash, bkt, tmp, mark, hash)
+        mark_release(mark);
+    spin_unlock_irqrestore(&mark_lock, flags);
+}
+
+int __init
+lksu_marks_init(void)
+{
+    mark_wq = alloc_workqueue("lksu-marks", WQ_UNBOUND, 0);
+    if (!mark_wq)
+        return -ENOMEM;
+
+    return 0;
+}
+
+void
+lksu_marks_exit(void)
+{
+    WRITE_ONCE(lksu_marks_enabled, false);
+    if (mark_wq)
+        destroy_workqueue(mark_wq);
+    lksu_marks_flush();
+}
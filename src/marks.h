@@ -0,0 +1,49 @@
+/* SPDX-License-Identifier: GPL-2.0-or-later */
+/*
+ * Copyright(c) 2024 John Sanpe <sanpeqf@gmail.com>
+ */
+
+#ifndef _LKSU_MARKS_H_
+#define _LKSU_MARKS_H_
+
+#include <linux/module.h>
+#include <linux/fs.h>
+
+#define LKSU_XATTR_NAME "security.lksu"
+
+extern bool lksu_marks_enabled;
+
+extern bool
+lksu_mark_check(const struct inode *inode);
+
+extern bool
+lksu_mark_check_ino(const struct super_block *sb, u64 ino);
+
+extern bool
+lksu_mark_check_dir(const struct inode *dir);
+
+extern int
+lksu_mark_watch(const char *name, bool hidden);
+
+extern void
+lksu_mark_instantiate(struct dentry *dentry, struct inode *inode);
+
+extern void
+lksu_mark_rename(struct dentry *old_dentry, struct dentry *new_dentry);
+
+extern void
+lksu_mark_inode_free(struct inode *inode);
+
+extern int
+lksu_marks_enable(bool enable);
+
+extern void
+lksu_marks_flush(void);
+
+extern int __init
+lksu_marks_init(void);
+
+extern void
+lksu_marks_exit(void);
+
+#endif /* _LKSU_MARKS_H_ */
@@ -0,0 +1,73 @@
+/* SPDX-License-Identifier: GPL-2.0-or-later */
+/*
+ * Copyright(c) 2024 John Sanpe <sanpeqf@gmail.com>
+ */
+
+#ifndef _LKSU_PHASH_H_
+#define _LKSU_PHASH_H_
+
+/*
+ * Perfect hash shared by the module and the gen-static host program,
+ * so it sticks to plain C types. One hash of the key selects a bucket
+ * whose displacement pair maps the key to a slot no other key uses.
+ */
+
+#define LKSU_PHASH_BASIS 0xcbf29ce484222325ULL
+#define LKSU_PHASH_PRIME 0x100000001b3ULL
+#define LKSU_PHASH_MULT 0x9e3779b97f4a7c15ULL
+
+struct lksu_phash {
+    unsigned long long seed;
+    unsigned int bucket_mask;
+    unsigned int slot_mask;
+    const unsigned int (*disp)[2];
+};
+
+struct lksu_phash_name {
+    const char *name;
+    unsigned int length;
+};
+
+static inline unsigned long long
+lksu_phash_hash(unsigned long long seed, const void *data, unsigned long length)
+{
+    const unsigned char *walk = data;
+    unsigned long long hash;
+
+    hash = LKSU_PHASH_BASIS ^ seed;
+    while (length--) {
+        hash ^= *walk++;
+        hash *= LKSU_PHASH_PRIME;
+    }
+
+    hash ^= hash >> 33;
+    hash *= 0xff51afd7ed558ccdULL;
+    hash ^= hash >> 33;
+
+    return hash;
+}
+
+static inline unsigned int
+lksu_phash_place(unsigned long long hash, const unsigned int *disp,
+                 unsigned int slot_mask)
+{
+    unsigned int first, second;
+
+    first = hash >> 32;
+    second = (unsigned int)((hash * LKSU_PHASH_MULT) >> 32) | 1;
+
+    return (first + disp[0] * second + disp[1]) & slot_mask;
+}
+
+static inline unsigned int
+lksu_phash_slot(const struct lksu_phash *phash, const void *data,
+                unsigned long length)
+{
+    unsigned long long hash;
+
+    hash = lksu_phash_hash(phash->seed, data, length);
+    return lksu_phash_place(hash, phash->disp[hash & phash->bucket_mask],
+                            phash->slot_mask);
+}
+
+#endif /* _LKSU_PHASH_H_ */
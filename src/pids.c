@@ -0,0 +1,217 @@
+/* SPDX-License-Identifier: GPL-2.0-or-later */
+/*
+ * Copyright(c) 2024 John Sanpe <sanpeqf@gmail.com>
+ */
+
+#define MODULE_NAME "lksu-pids"
+#define pr_fmt(fmt) MODULE_NAME ": " fmt
+
+#include "lksu.h"
+#include "pids.h"
+
+#include <linux/module.h>
+#include <linux/slab.h>
+#include <linux/hashtable.h>
+#include <linux/spinlock.h>
+#include <linux/rcupdate.h>
+#include <linux/sched/signal.h>
+#include <linux/printk.h>
+
+#define PIDS_HASH_BITS 6
+
+/*
+ * Hidden processes, keyed by the &struct pid of their thread group.
+ * Entries hold a reference, so a recycled pid number maps to another
+ * &struct pid and never matches a stale entry. Entries are dropped
+ * from task_free, which may run from an rcu callback, so the writer
+ * lock disables interrupts.
+ */
+struct lksu_pid_table {
+    struct hlist_node hash;
+    struct pid *pid;
+    struct rcu_head rcu;
+};
+
+unsigned int lksu_pids_count __read_mostly;
+static DEFINE_HASHTABLE(pid_hash, PIDS_HASH_BITS);
+static DEFINE_SPINLOCK(pid_lock);
+
+static struct lksu_pid_table *
+pid_lookup(struct pid *pid)
+{
+    struct lksu_pid_table *table;
+
+    hash_for_each_possible_rcu(pid_hash, table, hash, (unsigned long)pid) {
+        if (table->pid == pid)
+            return table;
+    }
+
+    return NULL;
+}
+
+static void
+pid_release(struct lksu_pid_table *table)
+{
+    hash_del_rcu(&table->hash);
+    WRITE_ONCE(lksu_pids_count, lksu_pids_count - 1);
+    put_pid(table->pid);
+    kfree_rcu(table, rcu);
+}
+
+/* Drops the entries whose thread group is gone. */
+static void
+pid_prune(void)
+{
+    struct lksu_pid_table *table;
+    struct hlist_node *tmp;
+    unsigned int bkt;
+
+    rcu_read_lock();
+    hash_for_each_safe(pid_hash, bkt, tmp, table, hash) {
+        if (!pid_task(table->pid, PIDTYPE_TGID))
+            pid_release(table);
+    }
+    rcu_read_unlock();
+}
+
+/* A process never hides from itself, /proc/self keeps working. */
+bool
+lksu_pid_check(struct pid *pid)
+{
+    struct task_struct *task;
+    bool hidden;
+
+    if (!lksu_pids_active())
+        return false;
+
+    hidden = false;
+    rcu_read_lock();
+    task = pid_task(pid, PIDTYPE_PID);
+    if (task) {
+        pid = task_tgid(task);
+        if (pid != task_tgid(current))
+            hidden = !!pid_lookup(pid);
+    }
+    rcu_read_unlock();
+
+    return hidden;
+}
+
+bool
+lksu_pid_check_nr(pid_t nr, struct pid_namespace *pid_ns)
+{
+    struct pid *pid;
+    bool hidden;
+
+    if (!lksu_pids_active())
+        return false;
+
+    rcu_read_lock();
+    pid = find_pid_ns(nr, pid_ns);
+    hidden = pid && lksu_pid_check(pid);
+    rcu_read_unlock();
+
+    return hidden;
+}
+
+int
+lksu_pid_add(pid_t nr)
+{
+    struct lksu_pid_table *table;
+    struct task_struct *task;
+    unsigned long flags;
+    struct pid *pid;
+
+    rcu_read_lock();
+    task = find_task_by_vpid(nr);
+    pid = task ? get_pid(task_tgid(task)) : NULL;
+    rcu_read_unlock();
+
+    if (!pid)
+        return -ESRCH;
+
+    table = kmalloc(sizeof(*table), GFP_KERNEL);
+    if (unlikely(!table)) {
+        put_pid(pid);
+        return -ENOMEM;
+    }
+
+    table->pid = pid;
+
+    spin_lock_irqsave(&pid_lock, flags);
+    pid_prune();
+    if (pid_lookup(pid)) {
+        spin_unlock_irqrestore(&pid_lock, flags);
+        put_pid(pid);
+        kfree(table);
+        return -EALREADY;
+    }
+
+    hash_add_rcu(pid_hash, &table->hash, (unsigned long)pid);
+    WRITE_ONCE(lksu_pids_count, lksu_pids_count + 1);
+    spin_unlock_irqrestore(&pid_lock, flags);
+
+    return 0;
+}
+
+int
+lksu_pid_remove(pid_t nr)
+{
+    struct lksu_pid_table *table;
+    struct task_struct *task;
+    unsigned long flags;
+    struct pid *pid;
+    int retval;
+
+    rcu_read_lock();
+    task = find_task_by_vpid(nr);
+    pid = task ? get_pid(task_tgid(task)) : NULL;
+    rcu_read_unlock();
+
+    if (!pid)
+        return -ESRCH;
+
+    retval = -ENOENT;
+    spin_lock_irqsave(&pid_lock, flags);
+    table = pid_lookup(pid);
+    if (table) {
+        pid_release(table);
+        retval = 0;
+    }
+    spin_unlock_irqrestore(&pid_lock, flags);
+    put_pid(pid);
+
+    return retval;
+}
+
+/*
+ * detach_pid() cleared thread_pid long before the task is freed, the
+ * entry can't be found from the task. Once a group leader is freed
+ * its tgid pid has no task left, so dead entries are pruned instead.
+ */
+void
+lksu_pid_task_free(struct task_struct *task)
+{
+    unsigned long flags;
+
+    if (!lksu_pids_active() || !thread_group_leader(task))
+        return;
+
+    spin_lock_irqsave(&pid_lock, flags);
+    pid_prune();
+    spin_unlock_irqrestore(&pid_lock, flags);
+}
+
+void
+lksu_pids_flush(void)
+{
+    struct lksu_pid_table *table;
+    struct hlist_node *tmp;
+    unsigned long flags;
+    unsigned int bkt;
+
+    spin_lock_irqsave(&pid_lock, flags);
+    hash_for_each_safe(pid_hash, bkt, tmp, table, hash)
+        pid_release(table);
+    spin_unlock_irqrestore(&pid_lock, flags);
+}
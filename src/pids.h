@@ -0,0 +1,40 @@
+/* SPDX-License-Identifier: GPL-2.0-or-later */
+/*
+ * Copyright(c) 2024 John Sanpe <sanpeqf@gmail.com>
+ */
+
+#ifndef _LKSU_PIDS_H_
+#define _LKSU_PIDS_H_
+
+#include <linux/module.h>
+#include <linux/types.h>
+#include <linux/pid.h>
+#include <linux/sched.h>
+
+extern unsigned int lksu_pids_count;
+
+static inline bool
+lksu_pids_active(void)
+{
+    return READ_ONCE(lksu_pids_count);
+}
+
+extern bool
+lksu_pid_check(struct pid *pid);
+
+extern bool
+lksu_pid_check_nr(pid_t nr, struct pid_namespace *pid_ns);
+
+extern int
+lksu_pid_add(pid_t nr);
+
+extern int
+lksu_pid_remove(pid_t nr);
+
+extern void
+lksu_pid_task_free(struct task_struct *task);
+
+extern void
+lksu_pids_flush(void);
+
+#endif /* _LKSU_PIDS_H_ */
@@ -9,73 +9,384 @@
 #include "lksu.h"
 #include "tables.h"
 #include "procfs.h"
+#include "trace.h"
+#include "events.h"
+#include "hooks.h"
 
 #include <linux/module.h>
 #include <linux/proc_fs.h>
 #include <linux/seq_file.h>
+#include <linux/slab.h>
+#include <linux/jiffies.h>
 #include <linux/printk.h>
 
-static struct proc_dir_entry *proc_entry;
+#define RULES_BATCH_SIZE (PATH_MAX * 2)
+#define RULES_UID_BATCH 128
+
+static struct proc_dir_entry *proc_dir;
+
+enum rules_stage {
+    RULES_FILE_HEADER = 0,
+    RULES_FILE,
+    RULES_UID_HEADER,
+    RULES_UID,
+    RULES_END,
+    RULES_DONE,
+};
+
+/*
+ * Both rules files walk the tables in batches that resume after the
+ * last entry seen, so the table locks are only held for one copy and
+ * the position stays valid whatever writers did in between.
+ */
+struct rules_iter {
+    enum rules_stage stage;
+    loff_t pos;
+
+    char *batch;
+    char *cursor;
+    size_t length;
+    size_t offset;
+
+    kuid_t uids[RULES_UID_BATCH];
+    unsigned int nr_uid;
+    unsigned int uid_index;
+};
+
+static void
+rules_advance(struct rules_iter *iter)
+{
+    const char *name;
+
+    switch (iter->stage) {
+        case RULES_FILE_HEADER:
+            iter->length = lksu_table_gfile_export(NULL, iter->batch, RULES_BATCH_SIZE);
+            iter->offset = 0;
+            iter->stage = iter->length ? RULES_FILE : RULES_UID_HEADER;
+            break;
+
+        case RULES_FILE:
+            name = iter->batch + iter->offset;
+            iter->offset += strlen(name) + 1;
+            if (iter->offset < iter->length)
+                break;
+
+            strscpy(iter->cursor, name, PATH_MAX);
+            iter->length = lksu_table_gfile_export(iter->cursor, iter->batch,
+                                                   RULES_BATCH_SIZE);
+            iter->offset = 0;
+            if (!iter->length)
+                iter->stage = RULES_UID_HEADER;
+            break;
+
+        case RULES_UID_HEADER:
+            iter->nr_uid = lksu_table_guid_export(NULL, iter->uids, RULES_UID_BATCH);
+            iter->uid_index = 0;
+            iter->stage = iter->nr_uid ? RULES_UID : RULES_END;
+            break;
+
+        case RULES_UID:
+            if (++iter->uid_index < iter->nr_uid)
+                break;
+
+            iter->nr_uid = lksu_table_guid_export(&iter->uids[iter->nr_uid - 1],
+                                                  iter->uids, RULES_UID_BATCH);
+            iter->uid_index = 0;
+            if (!iter->nr_uid)
+                iter->stage = RULES_END;
+            break;
+
+        default:
+            iter->stage = RULES_DONE;
+            break;
+    }
+
+    iter->pos++;
+}
+
+static void *
+rules_start(struct seq_file *seq, loff_t *pos)
+{
+    struct rules_iter *iter = seq->private;
+
+    /* Restarted reads and seeks backwards walk again from the top. */
+    if (!*pos || *pos < iter->pos) {
+        iter->stage = RULES_FILE_HEADER;
+        iter->pos = 0;
+    }
+
+    while (iter->pos < *pos && iter->stage != RULES_DONE)
+        rules_advance(iter);
+
+    return iter->stage != RULES_DONE ? iter : NULL;
+}
+
+static void *
+rules_next(struct seq_file *seq, void *val, loff_t *pos)
+{
+    struct rules_iter *iter = val;
+
+    rules_advance(iter);
+    ++*pos;
+
+    return iter->stage != RULES_DONE ? iter : NULL;
+}
+
+static void
+rules_stop(struct seq_file *seq, void *val)
+{
+}
 
 static int
-procfs_show(struct seq_file *seq, void *val)
+rules_show(struct seq_file *seq, void *val)
 {
-    struct rb_node *rb;
+    struct rules_iter *iter = val;
+    uid_t value;
 
-    seq_puts(seq, "global hidden files:\n");
-    read_lock(&lksu_gfile_lock);
-    for (rb = rb_first(&lksu_global_file); rb; rb = rb_next(rb)) {
-        struct lksu_file_table *file;
+    switch (iter->stage) {
+        case RULES_FILE_HEADER:
+            seq_puts(seq, "global hidden files:\n");
+            break;
 
-        file = lksu_node_to_file(rb);
-        seq_printf(seq, "\t%s\n", file->name);
+        case RULES_FILE:
+            seq_printf(seq, "\t%s\n", iter->batch + iter->offset);
+            break;
+
+        case RULES_UID_HEADER:
+            seq_puts(seq, "\nglobal whitelist uids:\n");
+            break;
+
+        case RULES_UID:
+            value = from_kuid(seq_user_ns(seq), iter->uids[iter->uid_index]);
+            seq_printf(seq, "\t%d\n", value);
+            break;
+
+        default:
+            seq_puts(seq, "\n");
+            break;
     }
-    read_unlock(&lksu_gfile_lock);
-    seq_puts(seq, "\n");
-
-    seq_puts(seq, "global whitelist uids:\n");
-    read_lock(&lksu_guid_lock);
-    for (rb = rb_first(&lksu_global_uid); rb; rb = rb_next(rb)) {
-        struct lksu_uid_table *uid;
-        uid_t value;
-
-        uid = lksu_node_to_uid(rb);
-        value = from_kuid(current_user_ns(), uid->kuid);
-        seq_printf(seq, "\t%d\n", value);
+
+    return 0;
+}
+
+static void
+hits_print(struct seq_file *seq, const struct lksu_hits *hits,
+           const char *name, uid_t uid)
+{
+    if (!hits->count)
+        seq_puts(seq, "\t0\t-\t");
+    else
+        seq_printf(seq, "\t%lu\t%u\t", hits->count,
+                   jiffies_to_msecs(jiffies - hits->last) / MSEC_PER_SEC);
+
+    if (name)
+        seq_printf(seq, "%s\n", name);
+    else
+        seq_printf(seq, "%d\n", uid);
+}
+
+/* Rules removed since their batch was taken are skipped. */
+static int
+hits_show(struct seq_file *seq, void *val)
+{
+    struct rules_iter *iter = val;
+    struct lksu_hits hits;
+    const char *name;
+    kuid_t kuid;
+
+    switch (iter->stage) {
+        case RULES_FILE_HEADER:
+            seq_puts(seq, "global hidden files (hits, seconds since last):\n");
+            break;
+
+        case RULES_FILE:
+            name = iter->batch + iter->offset;
+            if (lksu_table_gfile_hits(name, &hits))
+                hits_print(seq, &hits, name, 0);
+            break;
+
+        case RULES_UID_HEADER:
+            seq_puts(seq, "\nglobal whitelist uids (hits, seconds since last):\n");
+            break;
+
+        case RULES_UID:
+            kuid = iter->uids[iter->uid_index];
+            if (lksu_table_guid_hits(kuid, &hits))
+                hits_print(seq, &hits, NULL, from_kuid(seq_user_ns(seq), kuid));
+            break;
+
+        default:
+            seq_puts(seq, "\n");
+            break;
     }
-    read_unlock(&lksu_guid_lock);
-    seq_puts(seq, "\n");
 
     return 0;
 }
 
 static int
-procfs_open(struct inode *inode, struct file *file)
+dump_show(struct seq_file *seq, void *val)
 {
-	return single_open(file, procfs_show, NULL);
+    struct rules_iter *iter = val;
+    struct lksu_dump_record record;
+    const char *name;
+    size_t length;
+
+    memset(&record, 0, sizeof(record));
+
+    switch (iter->stage) {
+        case RULES_FILE:
+            name = iter->batch + iter->offset;
+            length = strlen(name);
+            record.size = sizeof(record) + length;
+            record.type = LKSU_DUMP_FILE;
+            seq_write(seq, &record, sizeof(record));
+            seq_write(seq, name, length);
+            break;
+
+        case RULES_UID:
+            record.size = sizeof(record);
+            record.type = LKSU_DUMP_UID;
+            record.uid = from_kuid(seq_user_ns(seq), iter->uids[iter->uid_index]);
+            seq_write(seq, &record, sizeof(record));
+            break;
+
+        default:
+            break;
+    }
+
+    return 0;
+}
+
+static const struct seq_operations
+rules_seq_ops = {
+    .start = rules_start,
+    .next = rules_next,
+    .stop = rules_stop,
+    .show = rules_show,
+};
+
+static const struct seq_operations
+hits_seq_ops = {
+    .start = rules_start,
+    .next = rules_next,
+    .stop = rules_stop,
+    .show = hits_show,
+};
+
+static const struct seq_operations
+dump_seq_ops = {
+    .start = rules_start,
+    .next = rules_next,
+    .stop = rules_stop,
+    .show = dump_show,
+};
+
+static int
+rules_iter_open(struct file *file, const struct seq_operations *ops)
+{
+    struct rules_iter *iter;
+
+    iter = __seq_open_private(file, ops, sizeof(*iter));
+    if (!iter)
+        return -ENOMEM;
+
+    iter->batch = kvmalloc(RULES_BATCH_SIZE + PATH_MAX, GFP_KERNEL);
+    if (!iter->batch) {
+        seq_release_private(file_inode(file), file);
+        return -ENOMEM;
+    }
+
+    iter->cursor = iter->batch + RULES_BATCH_SIZE;
+
+    return 0;
+}
+
+static int
+rules_open(struct inode *inode, struct file *file)
+{
+    return rules_iter_open(file, &rules_seq_ops);
+}
+
+static int
+hits_open(struct inode *inode, struct file *file)
+{
+    return rules_iter_open(file, &hits_seq_ops);
+}
+
+static int
+dump_open(struct inode *inode, struct file *file)
+{
+    return rules_iter_open(file, &dump_seq_ops);
+}
+
+static int
+rules_release(struct inode *inode, struct file *file)
+{
+    struct seq_file *seq = file->private_data;
+    struct rules_iter *iter = seq->private;
+
+    kvfree(iter->batch);
+    return seq_release_private(inode, file);
 }
 
 static const struct proc_ops
-procfs_ops = {
-    .proc_open = procfs_open,
+rules_ops = {
+    .proc_open = rules_open,
+    .proc_read = seq_read,
+    .proc_lseek = seq_lseek,
+    .proc_release = rules_release,
+};
+
+static const struct proc_ops
+hits_ops = {
+    .proc_open = hits_open,
+    .proc_read = seq_read,
+    .proc_lseek = seq_lseek,
+    .proc_release = rules_release,
+};
+
+static const struct proc_ops
+dump_ops = {
+    .proc_open = dump_open,
     .proc_read = seq_read,
     .proc_lseek = seq_lseek,
-    .proc_release = seq_release_private,
-    .proc_release = single_release,
+    .proc_release = rules_release,
 };
 
 int __init
 lksu_procfs_init(void)
 {
-    proc_entry = proc_create("lksu", 0440, NULL, &procfs_ops);
-    if (!proc_entry)
+    proc_dir = proc_mkdir_mode("lksu", 0550, NULL);
+    if (!proc_dir)
         return -ENOMEM;
 
+    if (!proc_create("rules", 0440, proc_dir, &rules_ops))
+        goto failed;
+
+    if (!proc_create("dump", 0440, proc_dir, &dump_ops))
+        goto failed;
+
+    if (!proc_create("hits", 0440, proc_dir, &hits_ops))
+        goto failed;
+
+    if (!proc_create("trace", 0440, proc_dir, &lksu_trace_ops))
+        goto failed;
+
+    if (!proc_create("events", 0440, proc_dir, &lksu_events_ops))
+        goto failed;
+
+    if (!proc_create_single("filters", 0440, proc_dir, lksu_hooks_filters_show))
+        goto failed;
+
     return 0;
+
+failed:
+    proc_remove(proc_dir);
+    return -ENOMEM;
 }
 
 void
 lksu_procfs_exit(void)
 {
-    proc_remove(proc_entry);
+    proc_remove(proc_dir);
 }
@@ -49,4 +49,44 @@ lksu_rb_find(const void *key, const struct rb_root *tree,
     return NULL;
 }
 
+/* First node not ordered before @key, the start of a range. */
+static __always_inline struct rb_node *
+lksu_rb_find_first(const void *key, const struct rb_root *tree,
+                   int (*cmp)(const void *key, const struct rb_node *))
+{
+    struct rb_node *node = tree->rb_node;
+    struct rb_node *match = NULL;
+
+    while (node) {
+        if (cmp(key, node) <= 0) {
+            match = node;
+            node = node->rb_left;
+        } else {
+            node = node->rb_right;
+        }
+    }
+
+    return match;
+}
+
+/* First node ordered after @key, for iterations resuming by key. */
+static __always_inline struct rb_node *
+lksu_rb_find_after(const void *key, const struct rb_root *tree,
+                   int (*cmp)(const void *key, const struct rb_node *))
+{
+    struct rb_node *node = tree->rb_node;
+    struct rb_node *match = NULL;
+
+    while (node) {
+        if (cmp(key, node) < 0) {
+            match = node;
+            node = node->rb_left;
+        } else {
+            node = node->rb_right;
+        }
+    }
+
+    return match;
+}
+
 #endif /* _LOCAL_RBTREE_H_ */
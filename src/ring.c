@@ -0,0 +1,238 @@
+/* SPDX-License-Identifier: GPL-2.0-or-later */
+/*
+ * Copyright(c) 2024 John Sanpe <sanpeqf@gmail.com>
+ */
+
+#define MODULE_NAME "lksu-ring"
+#define pr_fmt(fmt) MODULE_NAME ": " fmt
+
+#include "lksu.h"
+#include "ring.h"
+
+#include <linux/module.h>
+#include <linux/slab.h>
+#include <linux/vmalloc.h>
+#include <linux/log2.h>
+#include <linux/cpumask.h>
+#include <linux/topology.h>
+#include <linux/uaccess.h>
+#include <linux/irqflags.h>
+
+/*
+ * One byte ring per possible cpu. Each ring has a single producer,
+ * the cpu it belongs to writing with interrupts off, and a single
+ * consumer, readers being serialized by the caller. Head and tail are
+ * only ever advanced by their owner and published with release
+ * ordering, so neither side takes a lock. Records are stored as a u32
+ * length followed by the payload and a record that does not fit is
+ * dropped, never overwritten.
+ */
+#define RING_RECORD_MAX (PATH_MAX + 256)
+
+static void
+ring_copy_in(struct lksu_ring *ring, struct lksu_ring_cpu *rcpu,
+             size_t head, const void *src, size_t length)
+{
+    size_t offset, first;
+
+    offset = head & (ring->size - 1);
+    first = min(length, ring->size - offset);
+
+    memcpy(rcpu->data + offset, src, first);
+    memcpy(rcpu->data, src + first, length - first);
+}
+
+static void
+ring_copy_out(struct lksu_ring *ring, struct lksu_ring_cpu *rcpu,
+              size_t tail, void *dest, size_t length)
+{
+    size_t offset, first;
+
+    offset = tail & (ring->size - 1);
+    first = min(length, ring->size - offset);
+
+    memcpy(dest, rcpu->data + offset, first);
+    memcpy(dest + first, rcpu->data, length - first);
+}
+
+static int
+ring_copy_user(struct lksu_ring *ring, struct lksu_ring_cpu *rcpu,
+               size_t tail, char __user *dest, size_t length)
+{
+    size_t offset, first;
+
+    offset = tail & (ring->size - 1);
+    first = min(length, ring->size - offset);
+
+    if (copy_to_user(dest, rcpu->data + offset, first) ||
+        copy_to_user(dest + first, rcpu->data, length - first))
+        return -EFAULT;
+
+    return 0;
+}
+
+bool
+lksu_ring_write(struct lksu_ring *ring, const void *head, size_t hlen,
+                const void *data, size_t dlen)
+{
+    struct lksu_ring_cpu *rcpu;
+    unsigned long flags;
+    size_t pos, tail;
+    u32 length;
+
+    length = hlen + dlen;
+
+    local_irq_save(flags);
+    rcpu = ring->cpu[smp_processor_id()];
+
+    if (unlikely(length > RING_RECORD_MAX))
+        goto dropped;
+
+    pos = rcpu->head;
+    tail = smp_load_acquire(&rcpu->tail);
+    if (ring->size - (pos - tail) < sizeof(length) + length)
+        goto dropped;
+
+    ring_copy_in(ring, rcpu, pos, &length, sizeof(length));
+    ring_copy_in(ring, rcpu, pos + sizeof(length), head, hlen);
+    ring_copy_in(ring, rcpu, pos + sizeof(length) + hlen, data, dlen);
+    smp_store_release(&rcpu->head, pos + sizeof(length) + length);
+    local_irq_restore(flags);
+
+    return true;
+
+dropped:
+    WRITE_ONCE(rcpu->dropped, rcpu->dropped + 1);
+    local_irq_restore(flags);
+    return false;
+}
+
+/*
+ * Copies whole records only. Returns -EINVAL when records are pending
+ * but the first one does not fit into @count.
+ */
+ssize_t
+lksu_ring_read(struct lksu_ring *ring, char __user *buffer, size_t count)
+{
+    struct lksu_ring_cpu *rcpu;
+    size_t head, tail;
+    unsigned int cpu;
+    ssize_t copied;
+    bool pending;
+    u32 length;
+
+    copied = 0;
+    pending = false;
+
+    for_each_possible_cpu(cpu) {
+        rcpu = ring->cpu[cpu];
+        head = smp_load_acquire(&rcpu->head);
+        tail = rcpu->tail;
+
+        while (tail != head) {
+            ring_copy_out(ring, rcpu, tail, &length, sizeof(length));
+            if (length > count - copied) {
+                pending = true;
+                break;
+            }
+
+            if (ring_copy_user(ring, rcpu, tail + sizeof(length),
+                               buffer + copied, length)) {
+                smp_store_release(&rcpu->tail, tail);
+                return copied ?: -EFAULT;
+            }
+
+            tail += sizeof(length) + length;
+            copied += length;
+        }
+
+        smp_store_release(&rcpu->tail, tail);
+        if (pending)
+            break;
+    }
+
+    if (!copied && pending)
+        return -EINVAL;
+
+    return copied;
+}
+
+/* Drops pending records, serialized by the caller like reads. */
+void
+lksu_ring_reset(struct lksu_ring *ring)
+{
+    struct lksu_ring_cpu *rcpu;
+    unsigned int cpu;
+
+    for_each_possible_cpu(cpu) {
+        rcpu = ring->cpu[cpu];
+        smp_store_release(&rcpu->tail, smp_load_acquire(&rcpu->head));
+    }
+}
+
+bool
+lksu_ring_empty(struct lksu_ring *ring)
+{
+    struct lksu_ring_cpu *rcpu;
+    unsigned int cpu;
+
+    for_each_possible_cpu(cpu) {
+        rcpu = ring->cpu[cpu];
+        if (READ_ONCE(rcpu->head) != READ_ONCE(rcpu->tail))
+            return false;
+    }
+
+    return true;
+}
+
+unsigned long
+lksu_ring_dropped(struct lksu_ring *ring)
+{
+    unsigned long dropped;
+    unsigned int cpu;
+
+    dropped = 0;
+    for_each_possible_cpu(cpu)
+        dropped += READ_ONCE(ring->cpu[cpu]->dropped);
+
+    return dropped;
+}
+
+struct lksu_ring *
+lksu_ring_alloc(size_t size)
+{
+    struct lksu_ring_cpu *rcpu;
+    struct lksu_ring *ring;
+    unsigned int cpu;
+
+    size = roundup_pow_of_two(max_t(size_t, size, RING_RECORD_MAX * 4));
+    ring = kzalloc(struct_size(ring, cpu, nr_cpu_ids), GFP_KERNEL);
+    if (unlikely(!ring))
+        return NULL;
+
+    ring->size = size;
+    for_each_possible_cpu(cpu) {
+        rcpu = vzalloc_node(sizeof(*rcpu) + size, cpu_to_node(cpu));
+        if (unlikely(!rcpu))
+            goto failed;
+
+        ring->cpu[cpu] = rcpu;
+    }
+
+    return ring;
+
+failed:
+    lksu_ring_free(ring);
+    return NULL;
+}
+
+void
+lksu_ring_free(struct lksu_ring *ring)
+{
+    unsigned int cpu;
+
+    for_each_possible_cpu(cpu)
+        vfree(ring->cpu[cpu]);
+
+    kfree(ring);
+}
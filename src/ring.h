@@ -0,0 +1,47 @@
+/* SPDX-License-Identifier: GPL-2.0-or-later */
+/*
+ * Copyright(c) 2024 John Sanpe <sanpeqf@gmail.com>
+ */
+
+#ifndef _LKSU_RING_H_
+#define _LKSU_RING_H_
+
+#include <linux/module.h>
+#include <linux/types.h>
+#include <linux/cache.h>
+
+struct lksu_ring_cpu {
+    size_t head;
+    unsigned long dropped;
+    size_t tail ____cacheline_aligned;
+    char data[] ____cacheline_aligned;
+};
+
+struct lksu_ring {
+    size_t size;
+    struct lksu_ring_cpu *cpu[];
+};
+
+extern struct lksu_ring *
+lksu_ring_alloc(size_t size);
+
+extern void
+lksu_ring_free(struct lksu_ring *ring);
+
+extern bool
+lksu_ring_write(struct lksu_ring *ring, const void *head, size_t hlen,
+                const void *data, size_t dlen);
+
+extern ssize_t
+lksu_ring_read(struct lksu_ring *ring, char __user *buffer, size_t count);
+
+extern void
+lksu_ring_reset(struct lksu_ring *ring);
+
+extern bool
+lksu_ring_empty(struct lksu_ring *ring);
+
+extern unsigned long
+lksu_ring_dropped(struct lksu_ring *ring);
+
+#endif /* _LKSU_RING_H_ */
@@ -0,0 +1,373 @@
+/* SPDX-License-Identifier: GPL-2.0-or-later */
+/*
+ * Copyright(c) 2024 John Sanpe <sanpeqf@gmail.com>
+ */
+
+#define MODULE_NAME "lksu-stress"
+#define pr_fmt(fmt) MODULE_NAME ": " fmt
+
+#include "lksu.h"
+#include "bench.h"
+#include "hidden.h"
+#include "tables.h"
+
+#include <linux/module.h>
+#include <linux/kthread.h>
+#include <linux/namei.h>
+#include <linux/file.h>
+#include <linux/fs.h>
+#include <linux/cred.h>
+#include <linux/ktime.h>
+#include <linux/slab.h>
+#include <linux/delay.h>
+#include <linux/seq_file.h>
+#include <linux/uaccess.h>
+#include <linux/version.h>
+#include <linux/printk.h>
+
+#define STRESS_THREADS_MAX 256
+#define STRESS_SECONDS_MAX 600
+#define STRESS_WRITER_FILES 64
+#define STRESS_FLUSH_PERIOD 4096
+#define STRESS_HIST_NR 40
+
+#if LINUX_VERSION_CODE >= KERNEL_VERSION(6, 0, 0)
+# define FILLDIR_RET bool
+# define FILLDIR_CONTINUE true
+#else
+# define FILLDIR_RET int
+# define FILLDIR_CONTINUE 0
+#endif
+
+struct stress_run;
+
+struct stress_thread {
+    struct stress_run *run;
+    struct task_struct *task;
+    unsigned int id;
+    unsigned int cpu;
+    bool writer;
+    u64 ops;
+    u64 hist[STRESS_HIST_NR];
+};
+
+struct stress_run {
+    unsigned int readers;
+    unsigned int writers;
+    unsigned int seconds;
+    u64 elapsed;
+    unsigned int nr_paths;
+    struct path paths[8];
+    struct stress_thread threads[];
+};
+
+static const char *
+stress_names[] = {
+    "/", "/proc", "/sys", "/dev",
+    "/tmp", "/etc", "/proc/self", "/proc/lksu",
+};
+
+static struct stress_run *stress_last;
+static DEFINE_MUTEX(stress_mutex);
+
+static inline void
+stress_record(struct stress_thread *thread, u64 start)
+{
+    u64 delta;
+
+    delta = ktime_get_ns() - start;
+    thread->hist[min_t(unsigned int, fls64(delta), STRESS_HIST_NR - 1)]++;
+    thread->ops++;
+}
+
+static FILLDIR_RET
+stress_actor(struct dir_context *ctx, const char *name, int namlen,
+             loff_t offset, u64 ino, unsigned int d_type)
+{
+    return FILLDIR_CONTINUE;
+}
+
+static void
+stress_dirent(const struct path *path)
+{
+    struct dir_context ctx = {
+        .actor = stress_actor,
+    };
+    struct file *file;
+
+    file = dentry_open(path, O_RDONLY | O_DIRECTORY, current_cred());
+    if (IS_ERR(file))
+        return;
+
+    if (!lksu_hidden_dirent(file))
+        iterate_dir(file, &ctx);
+
+    __fput_sync(file);
+}
+
+static int
+stress_reader(void *data)
+{
+    struct stress_thread *thread;
+    struct stress_run *run;
+    const struct path *path;
+    unsigned long count;
+    bool hidden;
+    u64 start;
+
+    thread = data;
+    run = thread->run;
+
+    for (count = 0; !kthread_should_stop(); ++count) {
+        path = &run->paths[count % run->nr_paths];
+        start = ktime_get_ns();
+
+        switch (count % 4) {
+            case 0:
+                lksu_hidden_path(path, &hidden);
+                break;
+
+            case 1:
+                lksu_hidden_inode(d_inode(path->dentry), &hidden);
+                break;
+
+            case 2:
+                lksu_table_guid_check(current_uid());
+                break;
+
+            default:
+                if (d_is_dir(path->dentry))
+                    stress_dirent(path);
+                break;
+        }
+
+        stress_record(thread, start);
+        if (!(count % 256))
+            cond_resched();
+    }
+
+    return 0;
+}
+
+static int
+stress_writer(void *data)
+{
+    struct stress_thread *thread;
+    char name[64];
+    unsigned long count;
+    u64 start;
+
+    thread = data;
+
+    for (count = 0; !kthread_should_stop(); ++count) {
+        snprintf(name, sizeof(name), "/proc/stress%u-%lu",
+                 thread->id, count % STRESS_WRITER_FILES);
+        start = ktime_get_ns();
+
+        if (!(count % STRESS_FLUSH_PERIOD))
+            lksu_table_flush();
+        else if ((count / STRESS_WRITER_FILES) % 2)
+            lksu_table_gfile_remove(name);
+        else
+            lksu_table_gfile_add(name);
+
+        stress_record(thread, start);
+        cond_resched();
+    }
+
+    return 0;
+}
+
+static u64
+stress_percentile(const struct stress_thread *thread, unsigned int permille)
+{
+    u64 target, sum;
+    unsigned int index;
+
+    target = div_u64(thread->ops * permille, 1000);
+    for (sum = index = 0; index < STRESS_HIST_NR; ++index) {
+        sum += thread->hist[index];
+        if (sum > target)
+            break;
+    }
+
+    return index ? BIT_ULL(min(index, 63U)) : 0;
+}
+
+static void
+stress_release(struct stress_run *run)
+{
+    unsigned int index;
+
+    if (!run)
+        return;
+
+    for (index = 0; index < run->nr_paths; ++index)
+        path_put(&run->paths[index]);
+
+    kfree(run);
+}
+
+static int
+stress_start(unsigned int readers, unsigned int writers, unsigned int seconds)
+{
+    struct stress_thread *thread;
+    struct stress_run *run;
+    unsigned int index, total;
+    u64 start;
+    int retval;
+
+    total = readers + writers;
+    run = kzalloc(struct_size(run, threads, total), GFP_KERNEL);
+    if (unlikely(!run))
+        return -ENOMEM;
+
+    run->readers = readers;
+    run->writers = writers;
+    run->seconds = seconds;
+
+    for (index = 0; index < ARRAY_SIZE(stress_names); ++index) {
+        if (!kern_path(stress_names[index], LOOKUP_FOLLOW,
+                       &run->paths[run->nr_paths]))
+            run->nr_paths++;
+    }
+
+    if (!run->nr_paths) {
+        kfree(run);
+        return -ENOENT;
+    }
+
+    retval = 0;
+    for (index = 0; index < total; ++index) {
+        thread = &run->threads[index];
+        thread->run = run;
+        thread->id = index;
+        thread->writer = index >= readers;
+        thread->cpu = cpumask_local_spread(index, NUMA_NO_NODE);
+
+        thread->task = kthread_create(
+            thread->writer ? stress_writer : stress_reader, thread,
+            "lksu-stress/%u", index
+        );
+
+        if (IS_ERR(thread->task)) {
+            retval = PTR_ERR(thread->task);
+            thread->task = NULL;
+            break;
+        }
+
+        kthread_bind(thread->task, thread->cpu);
+    }
+
+    start = ktime_get_ns();
+    for (index = 0; index < total; ++index) {
+        if (run->threads[index].task)
+            wake_up_process(run->threads[index].task);
+    }
+
+    if (!retval)
+        msleep_interruptible(seconds * MSEC_PER_SEC);
+
+    for (index = 0; index < total; ++index) {
+        if (run->threads[index].task)
+            kthread_stop(run->threads[index].task);
+    }
+    run->elapsed = max_t(u64, ktime_get_ns() - start, 1);
+
+    lksu_table_flush();
+    stress_release(stress_last);
+    stress_last = run;
+
+    return retval;
+}
+
+static ssize_t
+stress_write(struct file *file, const char __user *buf,
+             size_t count, loff_t *ppos)
+{
+    unsigned int readers, writers, seconds;
+    char *buffer;
+    int retval;
+
+    buffer = memdup_user_nul(buf, min_t(size_t, count, 64));
+    if (IS_ERR(buffer))
+        return PTR_ERR(buffer);
+
+    retval = sscanf(buffer, "%u %u %u", &readers, &writers, &seconds);
+    kfree(buffer);
+
+    if (retval != 3 || !readers || !seconds ||
+        readers + writers > STRESS_THREADS_MAX ||
+        seconds > STRESS_SECONDS_MAX)
+        return -EINVAL;
+
+    mutex_lock(&stress_mutex);
+    retval = stress_start(readers, writers, seconds);
+    mutex_unlock(&stress_mutex);
+
+    return retval ?: count;
+}
+
+static int
+stress_show(struct seq_file *seq, void *val)
+{
+    struct stress_thread *thread;
+    struct stress_run *run;
+    unsigned int index;
+
+    mutex_lock(&stress_mutex);
+    run = stress_last;
+    if (!run)
+        goto finish;
+
+    seq_printf(seq, "readers %u writers %u seconds %u\n",
+               run->readers, run->writers, run->seconds);
+    seq_printf(seq, "%-8s%-8s%6s%14s%10s%10s%10s\n", "thread", "role",
+               "cpu", "ops/s", "p50", "p99", "p99.9");
+
+    for (index = 0; index < run->readers + run->writers; ++index) {
+        thread = &run->threads[index];
+        seq_printf(seq, "%-8u%-8s%6u%14llu%10llu%10llu%10llu\n",
+                   thread->id, thread->writer ? "writer" : "reader",
+                   thread->cpu,
+                   div64_u64(thread->ops * NSEC_PER_SEC, run->elapsed),
+                   stress_percentile(thread, 500),
+                   stress_percentile(thread, 990),
+                   stress_percentile(thread, 999));
+    }
+
+finish:
+    mutex_unlock(&stress_mutex);
+    return 0;
+}
+
+static int
+stress_open(struct inode *inode, struct file *file)
+{
+    return single_open(file, stress_show, NULL);
+}
+
+static const struct file_operations
+stress_fops = {
+    .owner = THIS_MODULE,
+    .open = stress_open,
+    .read = seq_read,
+    .write = stress_write,
+    .llseek = seq_lseek,
+    .release = single_release,
+};
+
+void
+lksu_stress_init(struct dentry *root)
+{
+    debugfs_create_file("stress", 0600, root, NULL, &stress_fops);
+}
+
+void
+lksu_stress_exit(void)
+{
+    mutex_lock(&stress_mutex);
+    stress_release(stress_last);
+    stress_last = NULL;
+    mutex_unlock(&stress_mutex);
+}
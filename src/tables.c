@@ -8,218 +8,1911 @@
 
 #include "lksu.h"
 #include "tables.h"
+#include "phash.h"
+#include "static-rules.h"
 
 #include <linux/module.h>
 #include <linux/string.h>
 #include <linux/slab.h>
 #include <linux/bug.h>
 #include <linux/printk.h>
+#include <linux/sched.h>
+#include <linux/nsproxy.h>
+#include <linux/hashtable.h>
+#include <linux/mutex.h>
+#include <linux/xarray.h>
+#include <linux/cred.h>
+#include <linux/atomic.h>
+#include <linux/rwsem.h>
+#include <linux/sort.h>
+#include <linux/bitops.h>
+#include <linux/percpu.h>
+#include <linux/jiffies.h>
+#include <linux/topology.h>
+#include <linux/nodemask.h>
+#include <linux/version.h>
+
+#if LINUX_VERSION_CODE >= KERNEL_VERSION(6, 12, 0)
+# include <linux/unaligned.h>
+#else
+# include <asm/unaligned.h>
+#endif
+
+#define RULESET_HASH_BITS 10
+#define BASE_FILTER_BITS 11
+
+struct lksu_ruleset lksu_global_ruleset = {
+    .file = RB_ROOT,
+    .lock = __RW_LOCK_UNLOCKED(lksu_global_ruleset.lock),
+};
+
+static DEFINE_HASHTABLE(ruleset_hash, RULESET_HASH_BITS);
+static DEFINE_MUTEX(ruleset_mutex);
+
+static struct kmem_cache *guid_cache;
+struct rb_root lksu_global_uid = RB_ROOT;
+DEFINE_RWLOCK(lksu_guid_lock);
+
+/*
+ * Per-uid hidden files: the xarray maps every kuid of a rule range to
+ * its &struct lksu_uid_rules, whose tree references path strings that
+ * are shared through uid_path_pool by all ranges hiding the same file.
+ */
+#define UID_RANGE_MAX 0x10000
+
+static struct kmem_cache *ufile_cache;
+static DEFINE_XARRAY(uid_rules);
+static struct rb_root uid_path_pool = RB_ROOT;
+static DEFINE_MUTEX(uid_rules_mutex);
+
+/*
+ * Path strings are split into an interned &struct lksu_dir and the
+ * basename kept inline in the entry, so rules below one directory
+ * share its prefix. Entries and directories come from size classes
+ * finer than the kmalloc ones, larger names fall back to kmalloc.
+ */
+static const unsigned int
+name_classes[] = {
+    32, 40, 48, 56, 64, 80, 96, 112,
+    128, 160, 192, 224, 256, 320, 384, 512,
+};
+
+static struct kmem_cache *name_cache[ARRAY_SIZE(name_classes)];
+static atomic_long_t name_memory = ATOMIC_LONG_INIT(0);
+static struct rb_root dir_pool = RB_ROOT;
+static DEFINE_MUTEX(dir_mutex);
+static atomic_t base_filter[1 << BASE_FILTER_BITS];
+
+/*
+ * Sealed tables: the global files and whitelist uids are flattened
+ * into one read-only block. Files and directories are found through
+ * sorted fingerprint arrays pointing into a packed string pool, uids
+ * through an Eytzinger ordered array. The trees stay untouched while
+ * sealed, so unsealing only drops the block, and mutations fail with
+ * -EROFS in between.
+ *
+ * On NUMA machines every online node gets its own copy of the block
+ * in node local memory, readers pick the one of the node they run on.
+ * All copies hang off one replica set, publishing or dropping the set
+ * switches every node at once.
+ */
+struct seal_entry {
+    u64 hash;
+    u32 offset;
+    u32 length;
+};
+
+struct lksu_sealed {
+    const struct seal_entry *file;
+    const struct seal_entry *dir;
+    const u32 *uid;
+    struct lksu_hits __percpu **file_hits;
+    struct lksu_hits __percpu **uid_hits;
+    const char *pool;
+    size_t nr_file;
+    size_t nr_dir;
+    size_t nr_uid;
+    size_t size;
+};
+
+struct seal_replicas {
+    struct lksu_sealed *primary;
+    struct lksu_sealed *node[];
+};
+
+#define SEAL_HASH_MULT 0x9e3779b97f4a7c15ULL
+
+static struct seal_replicas __rcu *sealed_table;
+static DECLARE_RWSEM(seal_sem);
+
+/*
+ * Files are ordered by directory first and basename second, so that
+ * every entry of one directory is adjacent in the tree and a dirent
+ * lookup can binary search on the directory part alone.
+ */
+struct file_key {
+    const char *name;
+    const char *base;
+    size_t dirlen;
+};
+
+/* Our procfs directory, hidden along with everything below it. */
+static const char
+const_hidden[] = "/proc/lksu";
+
+static inline void
+file_key_init(struct file_key *key, const char *name)
+{
+    key->name = name;
+    key->base = kbasename(name);
+    key->dirlen = key->base > name ? key->base - name - 1 : 0;
+}
+
+static inline void
+dirent_key_init(struct file_key *key, const char *name)
+{
+    size_t length;
+
+    length = strlen(name);
+    if (length && name[length - 1] == '/')
+        length--;
+
+    key->name = name;
+    key->base = NULL;
+    key->dirlen = length;
+}
+
+static inline int
+dir_cmp(const char *na, size_t la, const char *nb, size_t lb)
+{
+    int retval;
+
+    retval = memcmp(na, nb, min(la, lb));
+    if (retval)
+        return retval;
+
+    if (la == lb)
+        return 0;
+
+    return la < lb ? -1 : 1;
+}
+
+/* Directories are interned, equal strings share one node. */
+static inline int
+entry_cmp(const struct lksu_dir *da, const char *ba,
+          const struct lksu_dir *db, const char *bb)
+{
+    int retval;
+
+    if (da != db) {
+        retval = dir_cmp(da->name, da->length, db->name, db->length);
+        if (retval)
+            return retval;
+    }
+
+    return strcmp(ba, bb);
+}
+
+static inline int
+file_key_cmp(const struct file_key *key, const struct lksu_dir *dir,
+             const char *base)
+{
+    int retval;
+
+    retval = dir_cmp(key->name, key->dirlen, dir->name, dir->length);
+    if (retval)
+        return retval;
+
+    return strcmp(key->base, base);
+}
+
+static bool
+file_cmp(struct rb_node *na, const struct rb_node *nb)
+{
+    const struct lksu_file_table *ta, *tb;
+
+    ta = lksu_node_to_file(na);
+    tb = lksu_node_to_file(nb);
+
+    return entry_cmp(ta->dir, ta->base, tb->dir, tb->base) < 0;
+}
+
+static int
+file_find(const void *key, const struct rb_node *node)
+{
+    const struct lksu_file_table *table;
+
+    table = lksu_node_to_file(node);
+
+    return file_key_cmp(key, table->dir, table->base);
+}
+
+static int
+dirent_find(const void *key, const struct rb_node *node)
+{
+    const struct lksu_file_table *table;
+    const struct file_key *fkey;
+
+    table = lksu_node_to_file(node);
+    fkey = key;
+
+    return dir_cmp(fkey->name, fkey->dirlen,
+                   table->dir->name, table->dir->length);
+}
+
+static bool
+dir_node_cmp(struct rb_node *na, const struct rb_node *nb)
+{
+    const struct lksu_dir *ta, *tb;
+
+    ta = lksu_node_to_dir(na);
+    tb = lksu_node_to_dir(nb);
+
+    return dir_cmp(ta->name, ta->length, tb->name, tb->length) < 0;
+}
+
+static int
+dir_find(const void *key, const struct rb_node *node)
+{
+    const struct file_key *fkey;
+    const struct lksu_dir *dir;
+
+    dir = lksu_node_to_dir(node);
+    fkey = key;
+
+    return dir_cmp(fkey->name, fkey->dirlen, dir->name, dir->length);
+}
+
+static bool
+uid_cmp(struct rb_node *na, const struct rb_node *nb)
+{
+    const struct lksu_uid_table *ta, *tb;
+
+    ta = lksu_node_to_uid(na);
+    tb = lksu_node_to_uid(nb);
+
+    return uid_lt(ta->kuid, tb->kuid);
+}
+
+static int
+uid_find(const void *key, const struct rb_node *node)
+{
+    const struct lksu_uid_table *table;
+    const kuid_t *kuidp;
+
+    table = lksu_node_to_uid(node);
+    kuidp = key;
+
+    if (uid_eq(*kuidp, table->kuid))
+        return 0;
+
+    return uid_lt(*kuidp, table->kuid) ? -1 : 1;
+}
+
+static bool
+upath_cmp(struct rb_node *na, const struct rb_node *nb)
+{
+    const struct lksu_uid_path *ta, *tb;
+
+    ta = lksu_node_to_upath(na);
+    tb = lksu_node_to_upath(nb);
+
+    return entry_cmp(ta->dir, ta->base, tb->dir, tb->base) < 0;
+}
+
+static int
+upath_find(const void *key, const struct rb_node *node)
+{
+    const struct lksu_uid_path *path;
+
+    path = lksu_node_to_upath(node);
+
+    return file_key_cmp(key, path->dir, path->base);
+}
+
+static bool
+ufile_cmp(struct rb_node *na, const struct rb_node *nb)
+{
+    const struct lksu_uid_file *ta, *tb;
+
+    ta = lksu_node_to_ufile(na);
+    tb = lksu_node_to_ufile(nb);
+
+    return upath_cmp(&ta->path->node, &tb->path->node);
+}
+
+static int
+ufile_find(const void *key, const struct rb_node *node)
+{
+    const struct lksu_uid_file *file;
+
+    file = lksu_node_to_ufile(node);
+
+    return upath_find(key, &file->path->node);
+}
+
+static int
+udirent_find(const void *key, const struct rb_node *node)
+{
+    const struct lksu_uid_file *file;
+    const struct file_key *fkey;
+
+    file = lksu_node_to_ufile(node);
+    fkey = key;
+
+    return dir_cmp(fkey->name, fkey->dirlen,
+                   file->path->dir->name, file->path->dir->length);
+}
+
+/* Word at a time multiplicative hash, collisions only cost a compare. */
+static inline u64
+seal_hash(const char *name, size_t length)
+{
+    u64 hash, word;
+
+    hash = length * SEAL_HASH_MULT;
+    for (; length >= sizeof(word); length -= sizeof(word)) {
+        word = get_unaligned((const u64 *)name);
+        hash = (hash ^ word) * SEAL_HASH_MULT;
+        hash ^= hash >> 29;
+        name += sizeof(word);
+    }
+
+    if (length) {
+        for (word = 0; length--;)
+            word = word << 8 | (u8)name[length];
+        hash = (hash ^ word) * SEAL_HASH_MULT;
+        hash ^= hash >> 29;
+    }
+
+    return hash;
+}
+
+/*
+ * Counting filter over the basenames of every file rule, whatever its
+ * scope. Rules match the whole path, so a name that hits an empty slot
+ * can not be hidden and callers skip building its path at all.
+ */
+static unsigned int
+base_slot(const char *name, size_t length)
+{
+    return seal_hash(name, length) >> (64 - BASE_FILTER_BITS);
+}
+
+static inline void
+base_get(const char *base)
+{
+    atomic_inc(&base_filter[base_slot(base, strlen(base))]);
+}
+
+static inline void
+base_put(const char *base)
+{
+    atomic_dec(&base_filter[base_slot(base, strlen(base))]);
+}
+
+static void *
+name_alloc(size_t size)
+{
+    unsigned int index;
+    void *object;
+
+    for (index = 0; index < ARRAY_SIZE(name_classes); ++index) {
+        if (size <= name_classes[index])
+            break;
+    }
+
+    if (index < ARRAY_SIZE(name_classes)) {
+        object = kmem_cache_alloc(name_cache[index], GFP_KERNEL);
+        size = name_classes[index];
+    } else {
+        object = kmalloc(size, GFP_KERNEL);
+    }
+
+    if (likely(object))
+        atomic_long_add(size, &name_memory);
+
+    return object;
+}
+
+static void
+name_free(void *object, size_t size)
+{
+    unsigned int index;
+
+    for (index = 0; index < ARRAY_SIZE(name_classes); ++index) {
+        if (size <= name_classes[index])
+            break;
+    }
+
+    if (index < ARRAY_SIZE(name_classes)) {
+        kmem_cache_free(name_cache[index], object);
+        size = name_classes[index];
+    } else {
+        kfree(object);
+    }
+
+    atomic_long_sub(size, &name_memory);
+}
+
+static struct lksu_dir *
+dir_get(const struct file_key *key)
+{
+    struct lksu_dir *dir;
+    struct rb_node *rb;
+
+    mutex_lock(&dir_mutex);
+    rb = lksu_rb_find(key, &dir_pool, dir_find);
+    if (rb) {
+        dir = lksu_node_to_dir(rb);
+        dir->refcnt++;
+        goto finish;
+    }
+
+    dir = name_alloc(struct_size(dir, name, key->dirlen + 1));
+    if (unlikely(!dir))
+        goto finish;
+
+    memcpy(dir->name, key->name, key->dirlen);
+    dir->name[key->dirlen] = '\0';
+    dir->length = key->dirlen;
+    dir->refcnt = 1;
+    lksu_rb_add(&dir->node, &dir_pool, dir_node_cmp);
+
+finish:
+    mutex_unlock(&dir_mutex);
+    return dir;
+}
+
+static void
+dir_put(struct lksu_dir *dir)
+{
+    mutex_lock(&dir_mutex);
+    if (--dir->refcnt) {
+        mutex_unlock(&dir_mutex);
+        return;
+    }
+
+    rb_erase(&dir->node, &dir_pool);
+    mutex_unlock(&dir_mutex);
+
+    name_free(dir, struct_size(dir, name, dir->length + 1));
+}
+
+static struct lksu_file_table *
+file_alloc(const struct file_key *key)
+{
+    struct lksu_file_table *file;
+    size_t length;
+
+    length = strlen(key->base);
+    file = name_alloc(struct_size(file, base, length + 1));
+    if (unlikely(!file))
+        return NULL;
+
+    file->hits = alloc_percpu(struct lksu_hits);
+    if (unlikely(!file->hits))
+        goto free_file;
+
+    file->dir = dir_get(key);
+    if (unlikely(!file->dir))
+        goto free_hits;
+
+    memcpy(file->base, key->base, length);
+    file->base[length] = '\0';
+    base_get(file->base);
+
+    return file;
+
+free_hits:
+    free_percpu(file->hits);
+free_file:
+    name_free(file, struct_size(file, base, length + 1));
+    return NULL;
+}
+
+static void
+file_free(struct lksu_file_table *file)
+{
+    base_put(file->base);
+    dir_put(file->dir);
+    free_percpu(file->hits);
+    name_free(file, struct_size(file, base, strlen(file->base) + 1));
+}
+
+static struct lksu_uid_table *
+uid_alloc(kuid_t kuid)
+{
+    struct lksu_uid_table *uid;
+
+    uid = kmem_cache_alloc(guid_cache, GFP_KERNEL);
+    if (unlikely(!uid))
+        return NULL;
+
+    uid->hits = alloc_percpu(struct lksu_hits);
+    if (unlikely(!uid->hits)) {
+        kmem_cache_free(guid_cache, uid);
+        return NULL;
+    }
+
+    uid->kuid = kuid;
+
+    return uid;
+}
+
+static void
+uid_free(struct lksu_uid_table *uid)
+{
+    free_percpu(uid->hits);
+    kmem_cache_free(guid_cache, uid);
+}
+
+/* Plain per cpu ops, a match never writes a shared cacheline. */
+static inline void
+hits_bump(struct lksu_hits __percpu *hits)
+{
+    this_cpu_inc(hits->count);
+    this_cpu_write(hits->last, jiffies);
+}
+
+static void
+hits_sum(struct lksu_hits __percpu *hits, struct lksu_hits *sum)
+{
+    const struct lksu_hits *cpu_hits;
+    unsigned long count, last;
+    unsigned int cpu;
+
+    sum->count = 0;
+    sum->last = 0;
+
+    for_each_possible_cpu(cpu) {
+        cpu_hits = per_cpu_ptr(hits, cpu);
+        count = READ_ONCE(cpu_hits->count);
+        last = READ_ONCE(cpu_hits->last);
+        if (!count)
+            continue;
+
+        if (!sum->count || time_after(last, sum->last))
+            sum->last = last;
+        sum->count += count;
+    }
+}
+
+/*
+ * Static rules are compiled in by gen-static, a lookup costs one hash
+ * and one compare against the single slot the key can live in.
+ */
+static bool
+static_name_check(const struct lksu_phash *phash,
+                  const struct lksu_phash_name *slots,
+                  const char *name, size_t length)
+{
+    const struct lksu_phash_name *slot;
+
+    slot = &slots[lksu_phash_slot(phash, name, length)];
+    return slot->length == length && slot->name &&
+           !memcmp(slot->name, name, length);
+}
+
+static bool
+static_uid_check(uid_t uid)
+{
+    u8 key[4];
+
+    key[0] = uid;
+    key[1] = uid >> 8;
+    key[2] = uid >> 16;
+    key[3] = uid >> 24;
+
+    return static_uid_slot[lksu_phash_slot(&static_uid, key, sizeof(key))] == uid;
+}
+
+static bool
+const_gfile_check(const char *name)
+{
+    size_t length;
+
+    length = sizeof(const_hidden) - 1;
+    if (!strncmp(const_hidden, name, length) &&
+        (!name[length] || name[length] == '/'))
+        return true;
+
+    return static_name_check(&static_file, static_file_slot,
+                             name, strlen(name));
+}
+
+static bool
+const_gdirent_check(const struct file_key *key)
+{
+    size_t length;
+
+    length = strrchr(const_hidden, '/') - const_hidden;
+    if (!dir_cmp(key->name, key->dirlen, const_hidden, length))
+        return true;
+
+    return static_name_check(&static_dir, static_dir_slot,
+                             key->name, key->dirlen);
+}
+
+static const struct seal_entry *
+seal_search(const struct seal_entry *entry, size_t count,
+            const char *pool, const char *name, size_t length)
+{
+    const struct seal_entry *end;
+    size_t half;
+    u64 hash;
+
+    if (!count)
+        return NULL;
+
+    hash = seal_hash(name, length);
+    end = entry + count;
+
+    while (count > 1) {
+        half = count / 2;
+        entry = entry[half].hash < hash ? entry + half : entry;
+        count -= half;
+    }
+
+    for (entry += entry->hash < hash; entry < end; ++entry) {
+        if (entry->hash != hash)
+            break;
+        if (entry->length == length &&
+            !memcmp(pool + entry->offset, name, length))
+            return entry;
+    }
+
+    return NULL;
+}
+
+/* Returns the Eytzinger index of @uid, zero when it is not found. */
+static size_t
+seal_uid_find(const struct lksu_sealed *sealed, u32 uid)
+{
+    const u32 *array = sealed->uid;
+    size_t index = 1;
+
+    while (index <= sealed->nr_uid)
+        index = 2 * index + (array[index] < uid);
+    index >>= ffz(index) + 1;
+
+    return index && array[index] == uid ? index : 0;
+}
+
+static size_t
+seal_eytzinger(u32 *array, const u32 *sorted, size_t pos,
+               size_t index, size_t count)
+{
+    if (index > count)
+        return pos;
+
+    pos = seal_eytzinger(array, sorted, pos, 2 * index, count);
+    array[index] = sorted[pos++];
+
+    return seal_eytzinger(array, sorted, pos, 2 * index + 1, count);
+}
+
+static int
+seal_entry_cmp(const void *a, const void *b)
+{
+    const struct seal_entry *ea = a, *eb = b;
+
+    if (ea->hash == eb->hash)
+        return 0;
+
+    return ea->hash < eb->hash ? -1 : 1;
+}
+
+/* Called with seal_sem held for writing, no writer touches the trees. */
+static struct lksu_sealed *
+seal_build(void)
+{
+    struct lksu_sealed *sealed;
+    struct lksu_file_table *file;
+    struct lksu_uid_table *uid;
+    const struct lksu_dir *dir;
+    struct seal_entry *fentry, *dentry;
+    size_t nr_file, nr_uid, pool, size, index;
+    struct file_key key;
+    struct rb_node *rb;
+    kuid_t kuid;
+    u32 *sorted, *uarray;
+    char *string;
+
+    nr_file = pool = 0;
+    for (rb = rb_first(&lksu_global_ruleset.file); rb; rb = rb_next(rb)) {
+        file = lksu_node_to_file(rb);
+        pool += file->dir->length + strlen(file->base) + 2;
+        nr_file++;
+    }
+
+    nr_uid = 0;
+    for (rb = rb_first(&lksu_global_uid); rb; rb = rb_next(rb))
+        nr_uid++;
+
+    size = sizeof(*sealed) + sizeof(*fentry) * nr_file * 2 +
+           sizeof(*sealed->file_hits) * (nr_file + nr_uid + 1) +
+           sizeof(*uarray) * (nr_uid + 1) + pool;
+    sealed = kvmalloc(size, GFP_KERNEL);
+    sorted = kvmalloc_array(nr_uid + 1, sizeof(*sorted), GFP_KERNEL);
+    if (unlikely(!sealed || !sorted)) {
+        kvfree(sorted);
+        kvfree(sealed);
+        return ERR_PTR(-ENOMEM);
+    }
+
+    fentry = (void *)(sealed + 1);
+    dentry = fentry + nr_file;
+    sealed->file_hits = (void *)(dentry + nr_file);
+    sealed->uid_hits = sealed->file_hits + nr_file;
+    uarray = (void *)(sealed->uid_hits + nr_uid + 1);
+    string = (void *)(uarray + nr_uid + 1);
+
+    sealed->file = fentry;
+    sealed->dir = dentry;
+    sealed->uid = uarray;
+    sealed->pool = string;
+    sealed->nr_file = nr_file;
+    sealed->nr_dir = 0;
+    sealed->nr_uid = nr_uid;
+    sealed->size = size;
+
+    pool = 0;
+    dir = NULL;
+    for (rb = rb_first(&lksu_global_ruleset.file); rb; rb = rb_next(rb)) {
+        file = lksu_node_to_file(rb);
+        size = sprintf(string + pool, "%s/%s", file->dir->name, file->base);
+
+        fentry->hash = seal_hash(string + pool, size);
+        fentry->offset = pool;
+        fentry->length = size;
+        fentry++;
+
+        if (file->dir != dir) {
+            dir = file->dir;
+            dentry->hash = seal_hash(dir->name, dir->length);
+            dentry->offset = pool;
+            dentry->length = dir->length;
+            dentry++;
+            sealed->nr_dir++;
+        }
+
+        pool += size + 1;
+    }
+
+    sort((void *)sealed->file, sealed->nr_file, sizeof(*fentry),
+         seal_entry_cmp, NULL);
+    sort((void *)sealed->dir, sealed->nr_dir, sizeof(*dentry),
+         seal_entry_cmp, NULL);
+
+    nr_uid = 0;
+    for (rb = rb_first(&lksu_global_uid); rb; rb = rb_next(rb)) {
+        uid = lksu_node_to_uid(rb);
+        sorted[nr_uid++] = __kuid_val(uid->kuid);
+    }
+
+    uarray[0] = 0;
+    seal_eytzinger(uarray, sorted, 0, 1, nr_uid);
+    kvfree(sorted);
+
+    /* Matches while sealed still count against the tree entries. */
+    for (index = 0; index < sealed->nr_file; ++index) {
+        file_key_init(&key, sealed->pool + sealed->file[index].offset);
+        rb = lksu_rb_find(&key, &lksu_global_ruleset.file, file_find);
+        sealed->file_hits[index] = lksu_node_to_file(rb)->hits;
+    }
+
+    sealed->uid_hits[0] = NULL;
+    for (index = 1; index <= sealed->nr_uid; ++index) {
+        kuid = KUIDT_INIT(uarray[index]);
+        rb = lksu_rb_find(&kuid, &lksu_global_uid, uid_find);
+        sealed->uid_hits[index] = lksu_node_to_uid(rb)->hits;
+    }
+
+    return sealed;
+}
+
+#define seal_rebase(clone, sealed, ptr) \
+    ((void *)(clone) + ((const void *)(ptr) - (const void *)(sealed)))
+
+/* The block holds no pointer outside itself but the hit counters. */
+static struct lksu_sealed *
+seal_clone(const struct lksu_sealed *sealed, int node)
+{
+    struct lksu_sealed *clone;
+
+    clone = kvmalloc_node(sealed->size, GFP_KERNEL, node);
+    if (unlikely(!clone))
+        return NULL;
+
+    memcpy(clone, sealed, sealed->size);
+    clone->file = seal_rebase(clone, sealed, sealed->file);
+    clone->dir = seal_rebase(clone, sealed, sealed->dir);
+    clone->uid = seal_rebase(clone, sealed, sealed->uid);
+    clone->file_hits = seal_rebase(clone, sealed, sealed->file_hits);
+    clone->uid_hits = seal_rebase(clone, sealed, sealed->uid_hits);
+    clone->pool = seal_rebase(clone, sealed, sealed->pool);
+
+    return clone;
+}
+
+static void
+seal_replicas_free(struct seal_replicas *replicas)
+{
+    int node;
+
+    for (node = 0; node < nr_node_ids; ++node) {
+        if (replicas->node[node] != replicas->primary)
+            kvfree(replicas->node[node]);
+    }
+
+    kvfree(replicas->primary);
+    kfree(replicas);
+}
+
+/*
+ * Nodes coming online later and nodes a copy could not be allocated
+ * for share the primary block, it is only slower to reach from there.
+ */
+static struct seal_replicas *
+seal_replicate(struct lksu_sealed *sealed)
+{
+    struct seal_replicas *replicas;
+    int node;
+
+    replicas = kzalloc(struct_size(replicas, node, nr_node_ids), GFP_KERNEL);
+    if (unlikely(!replicas)) {
+        kvfree(sealed);
+        return ERR_PTR(-ENOMEM);
+    }
+
+    replicas->primary = sealed;
+    for (node = 0; node < nr_node_ids; ++node) {
+        if (num_online_nodes() > 1 && node_online(node))
+            replicas->node[node] = seal_clone(sealed, node);
+        if (!replicas->node[node])
+            replicas->node[node] = sealed;
+    }
+
+    return replicas;
+}
+
+static inline struct lksu_sealed *
+seal_local(void)
+{
+    struct seal_replicas *replicas;
+
+    replicas = rcu_dereference(sealed_table);
+    if (!replicas)
+        return NULL;
+
+    return replicas->node[numa_node_id()];
+}
+
+static inline int
+seal_enter(void)
+{
+    down_read(&seal_sem);
+    if (likely(!rcu_access_pointer(sealed_table)))
+        return 0;
+
+    up_read(&seal_sem);
+    return -EROFS;
+}
+
+static inline void
+seal_exit(void)
+{
+    up_read(&seal_sem);
+}
+
+static bool
+ruleset_file_check(struct lksu_ruleset *ruleset, const struct file_key *key)
+{
+    struct rb_node *rb;
+
+    read_lock(&ruleset->lock);
+    rb = lksu_rb_find(key, &ruleset->file, file_find);
+    if (rb)
+        hits_bump(lksu_node_to_file(rb)->hits);
+    read_unlock(&ruleset->lock);
+
+    return !!rb;
+}
+
+static bool
+ruleset_dirent_check(struct lksu_ruleset *ruleset, const struct file_key *key)
+{
+    struct rb_node *rb;
+
+    read_lock(&ruleset->lock);
+    rb = lksu_rb_find(key, &ruleset->file, dirent_find);
+    read_unlock(&ruleset->lock);
+
+    return !!rb;
+}
+
+static bool
+global_file_check(const struct file_key *key)
+{
+    const struct seal_entry *entry;
+    struct lksu_sealed *sealed;
+
+    rcu_read_lock();
+    sealed = seal_local();
+    if (sealed) {
+        entry = seal_search(sealed->file, sealed->nr_file, sealed->pool,
+                            key->name, strlen(key->name));
+        if (entry)
+            hits_bump(sealed->file_hits[entry - sealed->file]);
+        rcu_read_unlock();
+        return !!entry;
+    }
+    rcu_read_unlock();
+
+    return ruleset_file_check(&lksu_global_ruleset, key);
+}
+
+static bool
+global_dirent_check(const struct file_key *key)
+{
+    struct lksu_sealed *sealed;
+    bool hidden;
+
+    rcu_read_lock();
+    sealed = seal_local();
+    if (sealed) {
+        hidden = !!seal_search(sealed->dir, sealed->nr_dir, sealed->pool,
+                               key->name, key->dirlen);
+        rcu_read_unlock();
+        return hidden;
+    }
+    rcu_read_unlock();
+
+    return ruleset_dirent_check(&lksu_global_ruleset, key);
+}
+
+static int
+ruleset_file_add(struct lksu_ruleset *ruleset, const char *name)
+{
+    struct lksu_file_table *node;
+    struct file_key key;
+
+    if (*name != '/')
+        return -EINVAL;
+
+    file_key_init(&key, name);
+    node = file_alloc(&key);
+    if (unlikely(!node))
+        return -ENOMEM;
+
+    write_lock(&ruleset->lock);
+    if (lksu_rb_find(&key, &ruleset->file, file_find)) {
+        write_unlock(&ruleset->lock);
+        file_free(node);
+        return -EALREADY;
+    }
+
+    lksu_rb_add(&node->node, &ruleset->file, file_cmp);
+    write_unlock(&ruleset->lock);
+
+    return 0;
+}
+
+static int
+ruleset_file_remove(struct lksu_ruleset *ruleset, const char *name)
+{
+    struct lksu_file_table *node;
+    struct file_key key;
+    struct rb_node *rb;
+
+    if (*name != '/')
+        return -EINVAL;
+
+    file_key_init(&key, name);
+
+    write_lock(&ruleset->lock);
+    rb = lksu_rb_find(&key, &ruleset->file, file_find);
+    if (!rb) {
+        write_unlock(&ruleset->lock);
+        return -ENOENT;
+    }
+
+    node = lksu_node_to_file(rb);
+    rb_erase(&node->node, &ruleset->file);
+    write_unlock(&ruleset->lock);
+
+    file_free(node);
+
+    return 0;
+}
+
+/*
+ * Copies the next rule at or below @prefix into @buffer, after the
+ * one already in @buffer unless @first. Directories sharing the raw
+ * prefix, like "/a-b" for "/a", sort in between and are skipped.
+ */
+static bool
+ruleset_rename_next(struct lksu_ruleset *ruleset, const char *prefix,
+                    size_t length, char *buffer, bool first)
+{
+    struct lksu_file_table *file;
+    struct file_key key;
+    struct rb_node *rb;
+    bool found;
+
+    found = false;
+    read_lock(&ruleset->lock);
+
+    if (first) {
+        dirent_key_init(&key, prefix);
+        rb = lksu_rb_find_first(&key, &ruleset->file, dirent_find);
+    } else {
+        file_key_init(&key, buffer);
+        rb = lksu_rb_find_after(&key, &ruleset->file, file_find);
+    }
+
+    for (; rb; rb = rb_next(rb)) {
+        file = lksu_node_to_file(rb);
+        if (file->dir->length < length ||
+            memcmp(file->dir->name, prefix, length))
+            break;
+
+        if (file->dir->length == length || file->dir->name[length] == '/') {
+            snprintf(buffer, PATH_MAX, "%s/%s", file->dir->name, file->base);
+            found = true;
+            break;
+        }
+    }
+
+    read_unlock(&ruleset->lock);
+
+    return found;
+}
+
+static int
+ruleset_rename(struct lksu_ruleset *ruleset, const char *old,
+               const char *new, char *buffer)
+{
+    struct file_key key;
+    size_t oldlen, newlen;
+    char *target;
+    bool first, found;
+    int retval;
+
+    oldlen = strlen(old);
+    newlen = strlen(new);
+    target = buffer + PATH_MAX;
+
+    file_key_init(&key, old);
+    read_lock(&ruleset->lock);
+    found = !!lksu_rb_find(&key, &ruleset->file, file_find);
+    read_unlock(&ruleset->lock);
+
+    if (found) {
+        retval = ruleset_file_add(ruleset, new);
+        if (retval && retval != -EALREADY)
+            return retval;
+    }
+
+    for (first = true; ruleset_rename_next(ruleset, old, oldlen, buffer, first);
+         first = false) {
+        if (newlen + strlen(buffer + oldlen) >= PATH_MAX)
+            continue;
+
+        memcpy(target, new, newlen);
+        strcpy(target + newlen, buffer + oldlen);
+        retval = ruleset_file_add(ruleset, target);
+        if (retval && retval != -EALREADY)
+            return retval;
+    }
+
+    return 0;
+}
+
+static void
+ruleset_prune(struct lksu_ruleset *ruleset, const char *old, char *buffer)
+{
+    size_t oldlen;
+
+    oldlen = strlen(old);
+    ruleset_file_remove(ruleset, old);
+
+    while (ruleset_rename_next(ruleset, old, oldlen, buffer, true)) {
+        if (ruleset_file_remove(ruleset, buffer))
+            break;
+    }
+}
+
+static void
+ruleset_file_flush(struct lksu_ruleset *ruleset)
+{
+    struct lksu_file_table *file, *tfile;
+    struct rb_root root;
+
+    write_lock(&ruleset->lock);
+    root = ruleset->file;
+    ruleset->file = RB_ROOT;
+    write_unlock(&ruleset->lock);
+
+    rbtree_postorder_for_each_entry_safe(file, tfile, &root, node)
+        file_free(file);
+}
+
+static inline struct mnt_namespace *
+current_mnt_ns(void)
+{
+    struct nsproxy *nsproxy;
+
+    nsproxy = current->nsproxy;
+    if (unlikely(!nsproxy))
+        return NULL;
+
+    return nsproxy->mnt_ns;
+}
+
+static struct lksu_ruleset *
+ruleset_lookup(struct mnt_namespace *mnt_ns)
+{
+    struct lksu_ruleset *ruleset;
+
+    hash_for_each_possible_rcu(ruleset_hash, ruleset, hash,
+                               (unsigned long)mnt_ns) {
+        if (ruleset->mnt_ns == mnt_ns)
+            return ruleset;
+    }
+
+    return NULL;
+}
+
+static struct lksu_ruleset *
+ruleset_find(struct mnt_namespace *mnt_ns)
+{
+    struct lksu_ruleset *ruleset;
+
+    lockdep_assert_held(&ruleset_mutex);
+    hash_for_each_possible(ruleset_hash, ruleset, hash,
+                           (unsigned long)mnt_ns) {
+        if (ruleset->mnt_ns == mnt_ns)
+            return ruleset;
+    }
+
+    return NULL;
+}
+
+static struct lksu_ruleset *
+ruleset_create(struct mnt_namespace *mnt_ns, struct ns_common **pin)
+{
+    struct lksu_ruleset *ruleset;
+
+    lockdep_assert_held(&ruleset_mutex);
+    ruleset = kmalloc(sizeof(*ruleset), GFP_KERNEL);
+    if (unlikely(!ruleset))
+        return NULL;
+
+    ruleset->mnt_ns = mnt_ns;
+    ruleset->pin = *pin;
+    *pin = NULL;
+    ruleset->file = RB_ROOT;
+    rwlock_init(&ruleset->lock);
+    hash_add_rcu(ruleset_hash, &ruleset->hash, (unsigned long)mnt_ns);
+
+    return ruleset;
+}
+
+static void
+ruleset_release(struct lksu_ruleset *ruleset)
+{
+    lockdep_assert_held(&ruleset_mutex);
+    hash_del_rcu(&ruleset->hash);
+    ruleset_file_flush(ruleset);
+    ruleset->pin->ops->put(ruleset->pin);
+    kfree_rcu(ruleset, rcu);
+}
+
+static struct lksu_uid_path *
+upath_get(const char *name)
+{
+    struct lksu_uid_path *path;
+    struct file_key key;
+    struct rb_node *rb;
+    size_t length;
+
+    lockdep_assert_held(&uid_rules_mutex);
+    file_key_init(&key, name);
+
+    rb = lksu_rb_find(&key, &uid_path_pool, upath_find);
+    if (rb) {
+        path = lksu_node_to_upath(rb);
+        path->refcnt++;
+        return path;
+    }
+
+    length = strlen(key.base);
+    path = name_alloc(struct_size(path, base, length + 1));
+    if (unlikely(!path))
+        return NULL;
+
+    path->dir = dir_get(&key);
+    if (unlikely(!path->dir)) {
+        name_free(path, struct_size(path, base, length + 1));
+        return NULL;
+    }
+
+    memcpy(path->base, key.base, length);
+    path->base[length] = '\0';
+    path->refcnt = 1;
+    base_get(path->base);
+
+    lksu_rb_add(&path->node, &uid_path_pool, upath_cmp);
+
+    return path;
+}
+
+static void
+upath_put(struct lksu_uid_path *path)
+{
+    lockdep_assert_held(&uid_rules_mutex);
+    if (--path->refcnt)
+        return;
+
+    rb_erase(&path->node, &uid_path_pool);
+    base_put(path->base);
+    dir_put(path->dir);
+    name_free(path, struct_size(path, base, strlen(path->base) + 1));
+}
+
+static bool
+uid_rules_check(kuid_t kuid, const struct file_key *key,
+                int (*find)(const void *key, const struct rb_node *))
+{
+    struct lksu_uid_rules *rules;
+    struct rb_node *rb;
+
+    if (xa_empty(&uid_rules))
+        return false;
+
+    rb = NULL;
+    rcu_read_lock();
+    rules = xa_load(&uid_rules, __kuid_val(kuid));
+    if (rules) {
+        read_lock(&rules->lock);
+        rb = lksu_rb_find(key, &rules->file, find);
+        read_unlock(&rules->lock);
+    }
+    rcu_read_unlock();
+
+    return !!rb;
+}
+
+static int
+uid_rules_store(struct lksu_uid_rules *rules, struct lksu_uid_rules *entry)
+{
+#ifdef CONFIG_XARRAY_MULTI
+    return xa_err(xa_store_range(&uid_rules, rules->first,
+                                 rules->last, entry, GFP_KERNEL));
+#else
+    unsigned long index;
+    int retval;
+
+    for (index = rules->first; index <= rules->last; ++index) {
+        if (entry) {
+            retval = xa_err(xa_store(&uid_rules, index, entry, GFP_KERNEL));
+            if (unlikely(retval)) {
+                while (index-- > rules->first)
+                    xa_erase(&uid_rules, index);
+                return retval;
+            }
+        } else {
+            xa_erase(&uid_rules, index);
+        }
+    }
+
+    return 0;
+#endif
+}
+
+static struct lksu_uid_rules *
+uid_rules_get(uid_t first, uid_t last)
+{
+    struct lksu_uid_rules *rules;
+    unsigned long index;
+    int retval;
+
+    lockdep_assert_held(&uid_rules_mutex);
+
+    index = first;
+    rules = xa_find(&uid_rules, &index, last, XA_PRESENT);
+    if (rules) {
+        if (rules->first != first || rules->last != last)
+            return ERR_PTR(-EBUSY);
+        return rules;
+    }
+
+    if (!IS_ENABLED(CONFIG_XARRAY_MULTI) && last - first >= UID_RANGE_MAX)
+        return ERR_PTR(-E2BIG);
+
+    rules = kmalloc(sizeof(*rules), GFP_KERNEL);
+    if (unlikely(!rules))
+        return ERR_PTR(-ENOMEM);
+
+    rules->first = first;
+    rules->last = last;
+    rules->file = RB_ROOT;
+    rwlock_init(&rules->lock);
+
+    retval = uid_rules_store(rules, rules);
+    if (unlikely(retval)) {
+        kfree(rules);
+        return ERR_PTR(retval);
+    }
+
+    return rules;
+}
+
+static void
+uid_rules_release(struct lksu_uid_rules *rules)
+{
+    struct lksu_uid_file *file, *tfile;
+    struct rb_root root;
+
+    lockdep_assert_held(&uid_rules_mutex);
+    uid_rules_store(rules, NULL);
+
+    write_lock(&rules->lock);
+    root = rules->file;
+    rules->file = RB_ROOT;
+    write_unlock(&rules->lock);
+
+    rbtree_postorder_for_each_entry_safe(file, tfile, &root, node) {
+        upath_put(file->path);
+        kmem_cache_free(ufile_cache, file);
+    }
+
+    kfree_rcu(rules, rcu);
+}
+
+static int
+uid_rules_file_add(struct lksu_uid_rules *rules, const char *name)
+{
+    struct lksu_uid_file *node;
+    struct file_key key;
+
+    lockdep_assert_held(&uid_rules_mutex);
+    file_key_init(&key, name);
+    if (lksu_rb_find(&key, &rules->file, ufile_find))
+        return -EALREADY;
+
+    node = kmem_cache_alloc(ufile_cache, GFP_KERNEL);
+    if (unlikely(!node))
+        return -ENOMEM;
+
+    node->path = upath_get(name);
+    if (unlikely(!node->path)) {
+        kmem_cache_free(ufile_cache, node);
+        return -ENOMEM;
+    }
+
+    write_lock(&rules->lock);
+    lksu_rb_add(&node->node, &rules->file, ufile_cmp);
+    write_unlock(&rules->lock);
+
+    return 0;
+}
+
+static int
+uid_rules_file_remove(struct lksu_uid_rules *rules, const char *name)
+{
+    struct lksu_uid_file *node;
+    struct file_key key;
+    struct rb_node *rb;
+
+    lockdep_assert_held(&uid_rules_mutex);
+    file_key_init(&key, name);
+    rb = lksu_rb_find(&key, &rules->file, ufile_find);
+    if (!rb)
+        return -ENOENT;
+
+    node = lksu_node_to_ufile(rb);
+    write_lock(&rules->lock);
+    rb_erase(&node->node, &rules->file);
+    write_unlock(&rules->lock);
+
+    upath_put(node->path);
+    kmem_cache_free(ufile_cache, node);
+
+    return 0;
+}
+
+/* Same walk as ruleset_rename_next(), over the files of a uid range. */
+static bool
+uid_rules_rename_next(struct lksu_uid_rules *rules, const char *prefix,
+                      size_t length, char *buffer, bool first)
+{
+    struct lksu_uid_path *path;
+    struct file_key key;
+    struct rb_node *rb;
+
+    lockdep_assert_held(&uid_rules_mutex);
+
+    if (first) {
+        dirent_key_init(&key, prefix);
+        rb = lksu_rb_find_first(&key, &rules->file, udirent_find);
+    } else {
+        file_key_init(&key, buffer);
+        rb = lksu_rb_find_after(&key, &rules->file, ufile_find);
+    }
+
+    for (; rb; rb = rb_next(rb)) {
+        path = lksu_node_to_ufile(rb)->path;
+        if (path->dir->length < length ||
+            memcmp(path->dir->name, prefix, length))
+            break;
+
+        if (path->dir->length == length || path->dir->name[length] == '/') {
+            snprintf(buffer, PATH_MAX, "%s/%s", path->dir->name, path->base);
+            return true;
+        }
+    }
 
-struct rb_root lksu_global_file = RB_ROOT;
-DEFINE_RWLOCK(lksu_gfile_lock);
+    return false;
+}
 
-static struct kmem_cache *guid_cache;
-struct rb_root lksu_global_uid = RB_ROOT;
-DEFINE_RWLOCK(lksu_guid_lock);
+static int
+uid_rules_rename(struct lksu_uid_rules *rules, const char *old,
+                 const char *new, char *buffer)
+{
+    struct file_key key;
+    size_t oldlen, newlen;
+    char *target;
+    bool first;
+    int retval;
+
+    oldlen = strlen(old);
+    newlen = strlen(new);
+    target = buffer + PATH_MAX;
+
+    file_key_init(&key, old);
+    if (lksu_rb_find(&key, &rules->file, ufile_find)) {
+        retval = uid_rules_file_add(rules, new);
+        if (retval && retval != -EALREADY)
+            return retval;
+    }
 
-static const char *
-const_hidden[] = {
-    "/proc/lksu"
-};
+    for (first = true; uid_rules_rename_next(rules, old, oldlen, buffer, first);
+         first = false) {
+        if (newlen + strlen(buffer + oldlen) >= PATH_MAX)
+            continue;
 
-static inline int
-cmp_dirent(const char *file, const char *dirent)
+        memcpy(target, new, newlen);
+        strcpy(target + newlen, buffer + oldlen);
+        retval = uid_rules_file_add(rules, target);
+        if (retval && retval != -EALREADY)
+            return retval;
+    }
+
+    return 0;
+}
+
+static void
+uid_rules_prune(struct lksu_uid_rules *rules, const char *old, char *buffer)
 {
-    const char *name;
+    size_t oldlen;
 
-    name = strrchr(file, '/');
-    if (WARN_ON(!name))
-        return 0;
+    oldlen = strlen(old);
+    uid_rules_file_remove(rules, old);
 
-    return strncmp(file, dirent, name - file);
+    while (uid_rules_rename_next(rules, old, oldlen, buffer, true)) {
+        if (uid_rules_file_remove(rules, buffer))
+            break;
+    }
 }
 
-static bool
-file_cmp(struct rb_node *na, const struct rb_node *nb)
+bool
+lksu_table_base_check(const char *name, size_t length)
 {
-    const struct lksu_file_table *ta, *tb;
+    return !!atomic_read(&base_filter[base_slot(name, length)]);
+}
 
-    ta = lksu_node_to_file(na);
-    tb = lksu_node_to_file(nb);
+bool
+lksu_table_file_check(const char *name)
+{
+    struct lksu_ruleset *ruleset;
+    struct mnt_namespace *mnt_ns;
+    struct file_key key;
+    bool hidden;
+
+    if (const_gfile_check(name))
+        return true;
 
-    return strcmp(ta->name, tb->name) < 0;
+    file_key_init(&key, name);
+    if (global_file_check(&key))
+        return true;
+
+    if (uid_rules_check(current_uid(), &key, ufile_find))
+        return true;
+
+    mnt_ns = current_mnt_ns();
+    if (!mnt_ns)
+        return false;
+
+    hidden = false;
+    rcu_read_lock();
+    ruleset = ruleset_lookup(mnt_ns);
+    if (ruleset)
+        hidden = ruleset_file_check(ruleset, &key);
+    rcu_read_unlock();
+
+    return hidden;
 }
 
-static int
-file_find(const void *key, const struct rb_node *node)
+bool
+lksu_table_dirent_check(const char *name)
 {
-    const struct lksu_file_table *table;
+    struct lksu_ruleset *ruleset;
+    struct mnt_namespace *mnt_ns;
+    struct file_key key;
+    bool hidden;
 
-    table = lksu_node_to_file(node);
+    dirent_key_init(&key, name);
+    if (const_gdirent_check(&key))
+        return true;
+
+    if (global_dirent_check(&key))
+        return true;
+
+    if (uid_rules_check(current_uid(), &key, udirent_find))
+        return true;
 
-    return strcmp(table->name, key);
+    mnt_ns = current_mnt_ns();
+    if (!mnt_ns)
+        return false;
+
+    hidden = false;
+    rcu_read_lock();
+    ruleset = ruleset_lookup(mnt_ns);
+    if (ruleset)
+        hidden = ruleset_dirent_check(ruleset, &key);
+    rcu_read_unlock();
+
+    return hidden;
 }
 
-static int
-dirent_find(const void *key, const struct rb_node *node)
+bool
+lksu_table_gfile_check(const char *name)
 {
-    const struct lksu_file_table *table;
+    struct file_key key;
 
-    table = lksu_node_to_file(node);
+    if (const_gfile_check(name))
+        return true;
 
-    return cmp_dirent(table->name, key);
+    file_key_init(&key, name);
+    return global_file_check(&key);
 }
 
-static bool
-uid_cmp(struct rb_node *na, const struct rb_node *nb)
+bool
+lksu_table_gdirent_check(const char *name)
 {
-    const struct lksu_uid_table *ta, *tb;
+    struct file_key key;
 
-    ta = lksu_node_to_uid(na);
-    tb = lksu_node_to_uid(nb);
+    dirent_key_init(&key, name);
+    if (const_gdirent_check(&key))
+        return true;
 
-    return uid_lt(ta->kuid, tb->kuid);
+    return global_dirent_check(&key);
 }
 
-static int
-uid_find(const void *key, const struct rb_node *node)
+int
+lksu_table_gfile_add(const char *name)
 {
-    const struct lksu_uid_table *table;
-    const kuid_t *kuidp;
+    int retval;
 
-    table = lksu_node_to_uid(node);
-    kuidp = key;
+    retval = seal_enter();
+    if (retval)
+        return retval;
 
-    if (uid_eq(table->kuid, *kuidp))
-        return 0;
+    retval = ruleset_file_add(&lksu_global_ruleset, name);
+    seal_exit();
 
-    return uid_lt(table->kuid, *kuidp) ? -1 : 1;
+    return retval;
 }
 
-static bool
-const_gfile_check(const char *name)
+int
+lksu_table_gfile_remove(const char *name)
 {
-    unsigned int index;
+    int retval;
 
-    for (index = 0; index < ARRAY_SIZE(const_hidden); ++index) {
-        if (!strcmp(const_hidden[index], name))
-            return true;
-    }
+    retval = seal_enter();
+    if (retval)
+        return retval;
 
-    return false;
+    retval = ruleset_file_remove(&lksu_global_ruleset, name);
+    seal_exit();
+
+    return retval;
 }
 
-static bool
-const_gdirent_check(const char *name)
+int
+lksu_table_nsfile_add(struct mnt_namespace *mnt_ns, struct ns_common **pin,
+                      const char *name)
 {
-    unsigned int index;
-
-    for (index = 0; index < ARRAY_SIZE(const_hidden); ++index) {
-        if (!cmp_dirent(const_hidden[index], name))
-            return true;
+    struct lksu_ruleset *ruleset;
+    int retval;
+
+    retval = seal_enter();
+    if (retval)
+        return retval;
+
+    mutex_lock(&ruleset_mutex);
+    ruleset = ruleset_find(mnt_ns);
+    if (!ruleset) {
+        ruleset = ruleset_create(mnt_ns, pin);
+        if (unlikely(!ruleset)) {
+            retval = -ENOMEM;
+            goto finish;
+        }
     }
 
-    return false;
+    retval = ruleset_file_add(ruleset, name);
+    if (RB_EMPTY_ROOT(&ruleset->file))
+        ruleset_release(ruleset);
+
+finish:
+    mutex_unlock(&ruleset_mutex);
+    seal_exit();
+
+    return retval;
 }
 
-bool
-lksu_table_gfile_check(const char *name)
+int
+lksu_table_nsfile_remove(struct mnt_namespace *mnt_ns, const char *name)
 {
-    struct rb_node *rb;
+    struct lksu_ruleset *ruleset;
+    int retval;
+
+    retval = seal_enter();
+    if (retval)
+        return retval;
+
+    mutex_lock(&ruleset_mutex);
+    ruleset = ruleset_find(mnt_ns);
+    if (!ruleset) {
+        retval = -ENOENT;
+        goto finish;
+    }
 
-    if (const_gfile_check(name))
-        return true;
+    retval = ruleset_file_remove(ruleset, name);
+    if (RB_EMPTY_ROOT(&ruleset->file))
+        ruleset_release(ruleset);
 
-    read_lock(&lksu_gfile_lock);
-    rb = lksu_rb_find(name, &lksu_global_file, file_find);
-    read_unlock(&lksu_gfile_lock);
+finish:
+    mutex_unlock(&ruleset_mutex);
+    seal_exit();
 
-    return !!rb;
+    return retval;
 }
 
-bool
-lksu_table_gdirent_check(const char *name)
+void
+lksu_table_ns_flush(struct mnt_namespace *mnt_ns)
 {
-    struct rb_node *rb;
-
-    if (const_gdirent_check(name))
-        return true;
+    struct lksu_ruleset *ruleset;
 
-    read_lock(&lksu_gfile_lock);
-    rb = lksu_rb_find(name, &lksu_global_file, dirent_find);
-    read_unlock(&lksu_gfile_lock);
+    if (seal_enter())
+        return;
 
-    return !!rb;
+    mutex_lock(&ruleset_mutex);
+    ruleset = ruleset_find(mnt_ns);
+    if (ruleset)
+        ruleset_release(ruleset);
+    mutex_unlock(&ruleset_mutex);
+    seal_exit();
 }
 
+/*
+ * Hides @new wherever @old was hidden, the renamed path and everything
+ * below it. Both are paths as seen from @mnt_ns, only its own ruleset
+ * is followed besides the global and per-uid ones. Old rules are kept,
+ * the rename may still fail after the hook, and a hidden file must
+ * never become visible by way of one. lksu_table_prune() drops them
+ * once the rename went through.
+ */
 int
-lksu_table_gfile_add(const char *name)
+lksu_table_rename(struct mnt_namespace *mnt_ns, const char *old,
+                  const char *new)
 {
-    struct lksu_file_table *node;
-    const char *path;
-    size_t length;
+    struct lksu_uid_rules *rules;
+    struct lksu_ruleset *ruleset;
+    unsigned long index;
+    char *buffer;
+    int retval;
 
-    if (!*name)
+    if (*old != '/' || *new != '/')
         return -EINVAL;
 
-    write_lock(&lksu_gfile_lock);
-    if (lksu_rb_find(name, &lksu_global_file, file_find)) {
-        write_unlock(&lksu_gfile_lock);
-        return -EALREADY;
+    buffer = kmalloc(PATH_MAX * 2, GFP_KERNEL);
+    if (unlikely(!buffer))
+        return -ENOMEM;
+
+    retval = seal_enter();
+    if (retval)
+        goto finish;
+
+    retval = ruleset_rename(&lksu_global_ruleset, old, new, buffer);
+
+    if (!retval && mnt_ns && !hash_empty(ruleset_hash)) {
+        mutex_lock(&ruleset_mutex);
+        ruleset = ruleset_find(mnt_ns);
+        if (ruleset)
+            retval = ruleset_rename(ruleset, old, new, buffer);
+        mutex_unlock(&ruleset_mutex);
     }
 
-    length = strnlen(name, PATH_MAX);
-    node = kmalloc(sizeof(*node) + length + 1, GFP_KERNEL);
-    if (unlikely(!node)) {
-        write_unlock(&lksu_gfile_lock);
+    if (!retval && !xa_empty(&uid_rules)) {
+        mutex_lock(&uid_rules_mutex);
+        xa_for_each(&uid_rules, index, rules) {
+            if (index != rules->first)
+                continue;
+            retval = uid_rules_rename(rules, old, new, buffer);
+            if (retval)
+                break;
+        }
+        mutex_unlock(&uid_rules_mutex);
+    }
+    seal_exit();
+
+finish:
+    kfree(buffer);
+    return retval;
+}
+
+int
+lksu_table_prune(struct mnt_namespace *mnt_ns, const char *old)
+{
+    struct lksu_uid_rules *rules;
+    struct lksu_ruleset *ruleset;
+    unsigned long index;
+    char *buffer;
+    int retval;
+
+    if (*old != '/')
+        return -EINVAL;
+
+    buffer = kmalloc(PATH_MAX, GFP_KERNEL);
+    if (unlikely(!buffer))
         return -ENOMEM;
+
+    retval = seal_enter();
+    if (retval)
+        goto finish;
+
+    ruleset_prune(&lksu_global_ruleset, old, buffer);
+
+    if (mnt_ns && !hash_empty(ruleset_hash)) {
+        mutex_lock(&ruleset_mutex);
+        ruleset = ruleset_find(mnt_ns);
+        if (ruleset) {
+            ruleset_prune(ruleset, old, buffer);
+            if (RB_EMPTY_ROOT(&ruleset->file))
+                ruleset_release(ruleset);
+        }
+        mutex_unlock(&ruleset_mutex);
     }
 
-    memcpy(node->name, name, length);
-    node->name[length] = '\0';
+    if (!xa_empty(&uid_rules)) {
+        mutex_lock(&uid_rules_mutex);
+        xa_for_each(&uid_rules, index, rules) {
+            if (index != rules->first)
+                continue;
+            uid_rules_prune(rules, old, buffer);
+            if (RB_EMPTY_ROOT(&rules->file))
+                uid_rules_release(rules);
+        }
+        mutex_unlock(&uid_rules_mutex);
+    }
+    seal_exit();
 
-    path = kbasename(name);
-    node->dirlen = path - name - 1;
+finish:
+    kfree(buffer);
+    return retval;
+}
 
-    lksu_rb_add(&node->node, &lksu_global_file, file_cmp);
-    write_unlock(&lksu_gfile_lock);
+/* Cheap test for rename hooks, racy but rules only matter once added. */
+bool
+lksu_table_file_empty(void)
+{
+    return !READ_ONCE(lksu_global_ruleset.file.rb_node) &&
+           hash_empty(ruleset_hash) && xa_empty(&uid_rules);
+}
 
-    return 0;
+int
+lksu_table_uidfile_add(kuid_t first, kuid_t last, const char *name)
+{
+    struct lksu_uid_rules *rules;
+    int retval;
+
+    if (*name != '/' || uid_gt(first, last))
+        return -EINVAL;
+
+    retval = seal_enter();
+    if (retval)
+        return retval;
+
+    mutex_lock(&uid_rules_mutex);
+    rules = uid_rules_get(__kuid_val(first), __kuid_val(last));
+    if (IS_ERR(rules)) {
+        retval = PTR_ERR(rules);
+        goto finish;
+    }
+
+    retval = uid_rules_file_add(rules, name);
+    if (RB_EMPTY_ROOT(&rules->file))
+        uid_rules_release(rules);
+
+finish:
+    mutex_unlock(&uid_rules_mutex);
+    seal_exit();
+
+    return retval;
 }
 
 int
-lksu_table_gfile_remove(const char *name)
+lksu_table_uidfile_remove(kuid_t first, kuid_t last, const char *name)
 {
-    struct lksu_file_table *node;
-    struct rb_node *rb;
+    struct lksu_uid_rules *rules;
+    int retval;
 
-    if (!*name)
+    if (*name != '/' || uid_gt(first, last))
         return -EINVAL;
 
-    write_lock(&lksu_gfile_lock);
-    rb = lksu_rb_find(name, &lksu_global_file, file_find);
-    if (!rb) {
-        write_unlock(&lksu_gfile_lock);
-        return -ENOENT;
+    retval = seal_enter();
+    if (retval)
+        return retval;
+
+    mutex_lock(&uid_rules_mutex);
+    rules = xa_load(&uid_rules, __kuid_val(first));
+    if (!rules || rules->first != __kuid_val(first) ||
+        rules->last != __kuid_val(last)) {
+        retval = -ENOENT;
+        goto finish;
     }
 
-    node = lksu_node_to_file(rb);
-    rb_erase(&node->node, &lksu_global_file);
-    write_unlock(&lksu_gfile_lock);
+    retval = uid_rules_file_remove(rules, name);
+    if (RB_EMPTY_ROOT(&rules->file))
+        uid_rules_release(rules);
 
-    kfree(node);
+finish:
+    mutex_unlock(&uid_rules_mutex);
+    seal_exit();
 
-    return 0;
+    return retval;
 }
 
 bool
 lksu_table_guid_check(kuid_t kuid)
 {
+    struct lksu_sealed *sealed;
     struct rb_node *rb;
+    size_t index;
+
+    if (static_uid_check(__kuid_val(kuid)))
+        return true;
+
+    rcu_read_lock();
+    sealed = seal_local();
+    if (sealed) {
+        index = seal_uid_find(sealed, __kuid_val(kuid));
+        if (index)
+            hits_bump(sealed->uid_hits[index]);
+        rcu_read_unlock();
+        return !!index;
+    }
+    rcu_read_unlock();
 
-    read_lock(&lksu_gfile_lock);
+    read_lock(&lksu_guid_lock);
     rb = lksu_rb_find(&kuid, &lksu_global_uid, uid_find);
-    read_unlock(&lksu_gfile_lock);
+    if (rb)
+        hits_bump(lksu_node_to_uid(rb)->hits);
+    read_unlock(&lksu_guid_lock);
 
     return !!rb;
 }
@@ -228,22 +1921,29 @@ int
 lksu_table_guid_add(kuid_t kuid)
 {
     struct lksu_uid_table *node;
+    int retval;
+
+    retval = seal_enter();
+    if (retval)
+        return retval;
+
+    node = uid_alloc(kuid);
+    if (unlikely(!node)) {
+        seal_exit();
+        return -ENOMEM;
+    }
 
     write_lock(&lksu_guid_lock);
     if (lksu_rb_find(&kuid, &lksu_global_uid, uid_find)) {
         write_unlock(&lksu_guid_lock);
+        seal_exit();
+        uid_free(node);
         return -EALREADY;
     }
 
-    node = kmem_cache_alloc(guid_cache, GFP_KERNEL);
-    if (unlikely(!node)) {
-        write_unlock(&lksu_guid_lock);
-        return -ENOMEM;
-    }
-
-    node->kuid = kuid;
     lksu_rb_add(&node->node, &lksu_global_uid, uid_cmp);
     write_unlock(&lksu_guid_lock);
+    seal_exit();
 
     return 0;
 }
@@ -253,59 +1953,271 @@ lksu_table_guid_remove(kuid_t kuid)
 {
     struct lksu_uid_table *node;
     struct rb_node *rb;
+    int retval;
+
+    retval = seal_enter();
+    if (retval)
+        return retval;
 
     write_lock(&lksu_guid_lock);
     rb = lksu_rb_find(&kuid, &lksu_global_uid, uid_find);
     if (!rb) {
         write_unlock(&lksu_guid_lock);
+        seal_exit();
         return -ENOENT;
     }
 
     node = lksu_node_to_uid(rb);
-    rb_erase(&node->node, &lksu_global_file);
+    rb_erase(&node->node, &lksu_global_uid);
     write_unlock(&lksu_guid_lock);
+    seal_exit();
 
-    kmem_cache_free(guid_cache, node);
+    uid_free(node);
 
     return 0;
 }
 
+static void
+seal_drop(void)
+{
+    struct seal_replicas *replicas;
+
+    lockdep_assert_held_write(&seal_sem);
+    replicas = rcu_replace_pointer(sealed_table, NULL,
+                                   lockdep_is_held(&seal_sem));
+
+    if (replicas) {
+        synchronize_rcu();
+        seal_replicas_free(replicas);
+    }
+}
+
+/* Holds off a concurrent seal until every tree it would flatten is gone. */
 void
 lksu_table_flush(void)
 {
-    struct lksu_file_table *file, *tfile;
     struct lksu_uid_table *uid, *tuid;
-
-    write_lock(&lksu_gfile_lock);
-    rbtree_postorder_for_each_entry_safe(file, tfile, &lksu_global_file, node)
-        kfree(file);
-
-    lksu_global_file = RB_ROOT;
-    write_unlock(&lksu_gfile_lock);
+    struct lksu_uid_rules *rules;
+    struct lksu_ruleset *ruleset;
+    struct hlist_node *tmp;
+    unsigned long index;
+    unsigned int bkt;
+
+    down_write(&seal_sem);
+    seal_drop();
+    ruleset_file_flush(&lksu_global_ruleset);
+
+    mutex_lock(&ruleset_mutex);
+    hash_for_each_safe(ruleset_hash, bkt, tmp, ruleset, hash)
+        ruleset_release(ruleset);
+    mutex_unlock(&ruleset_mutex);
+
+    mutex_lock(&uid_rules_mutex);
+    xa_for_each(&uid_rules, index, rules) {
+        if (index == rules->first)
+            uid_rules_release(rules);
+    }
+    mutex_unlock(&uid_rules_mutex);
 
     write_lock(&lksu_guid_lock);
     rbtree_postorder_for_each_entry_safe(uid, tuid, &lksu_global_uid, node)
-        kmem_cache_free(guid_cache, uid);
+        uid_free(uid);
 
     lksu_global_uid = RB_ROOT;
     write_unlock(&lksu_guid_lock);
+    up_write(&seal_sem);
+}
+
+int
+lksu_table_seal(void)
+{
+    struct seal_replicas *replicas;
+    struct lksu_sealed *sealed;
+
+    down_write(&seal_sem);
+    if (rcu_access_pointer(sealed_table)) {
+        up_write(&seal_sem);
+        return -EALREADY;
+    }
+
+    sealed = seal_build();
+    if (IS_ERR(sealed)) {
+        up_write(&seal_sem);
+        return PTR_ERR(sealed);
+    }
+
+    replicas = seal_replicate(sealed);
+    if (!IS_ERR(replicas))
+        rcu_assign_pointer(sealed_table, replicas);
+    up_write(&seal_sem);
+
+    return PTR_ERR_OR_ZERO(replicas);
+}
+
+void
+lksu_table_unseal(void)
+{
+    down_write(&seal_sem);
+    seal_drop();
+    up_write(&seal_sem);
+}
+
+bool
+lksu_table_sealed(void)
+{
+    return !!rcu_access_pointer(sealed_table);
+}
+
+size_t
+lksu_table_memory(void)
+{
+    return atomic_long_read(&name_memory);
+}
+
+size_t
+lksu_table_gfile_export(const char *after, char *buffer, size_t size)
+{
+    struct lksu_file_table *file;
+    struct file_key key;
+    struct rb_node *rb;
+    size_t used, length;
+
+    used = 0;
+    read_lock(&lksu_global_ruleset.lock);
+
+    if (after) {
+        file_key_init(&key, after);
+        rb = lksu_rb_find_after(&key, &lksu_global_ruleset.file, file_find);
+    } else {
+        rb = rb_first(&lksu_global_ruleset.file);
+    }
+
+    for (; rb; rb = rb_next(rb)) {
+        file = lksu_node_to_file(rb);
+        length = file->dir->length + strlen(file->base) + 2;
+        if (used + length > size)
+            break;
+
+        memcpy(buffer + used, file->dir->name, file->dir->length);
+        buffer[used + file->dir->length] = '/';
+        strcpy(buffer + used + file->dir->length + 1, file->base);
+        used += length;
+    }
+
+    read_unlock(&lksu_global_ruleset.lock);
+
+    return used;
+}
+
+size_t
+lksu_table_guid_export(const kuid_t *after, kuid_t *buffer, size_t count)
+{
+    struct rb_node *rb;
+    size_t used;
+
+    used = 0;
+    read_lock(&lksu_guid_lock);
+
+    if (after)
+        rb = lksu_rb_find_after(after, &lksu_global_uid, uid_find);
+    else
+        rb = rb_first(&lksu_global_uid);
+
+    for (; rb && used < count; rb = rb_next(rb))
+        buffer[used++] = lksu_node_to_uid(rb)->kuid;
+
+    read_unlock(&lksu_guid_lock);
+
+    return used;
+}
+
+bool
+lksu_table_gfile_hits(const char *name, struct lksu_hits *hits)
+{
+    struct file_key key;
+    struct rb_node *rb;
+
+    file_key_init(&key, name);
+
+    read_lock(&lksu_global_ruleset.lock);
+    rb = lksu_rb_find(&key, &lksu_global_ruleset.file, file_find);
+    if (rb)
+        hits_sum(lksu_node_to_file(rb)->hits, hits);
+    read_unlock(&lksu_global_ruleset.lock);
+
+    return !!rb;
+}
+
+bool
+lksu_table_guid_hits(kuid_t kuid, struct lksu_hits *hits)
+{
+    struct rb_node *rb;
+
+    read_lock(&lksu_guid_lock);
+    rb = lksu_rb_find(&kuid, &lksu_global_uid, uid_find);
+    if (rb)
+        hits_sum(lksu_node_to_uid(rb)->hits, hits);
+    read_unlock(&lksu_guid_lock);
+
+    return !!rb;
+}
+
+static void
+name_cache_destroy(void)
+{
+    unsigned int index;
+
+    for (index = 0; index < ARRAY_SIZE(name_cache); ++index) {
+        kmem_cache_destroy(name_cache[index]);
+        name_cache[index] = NULL;
+    }
 }
 
 int __init
 lksu_tables_init(void)
 {
+    char cname[32];
+    unsigned int index;
+
+    for (index = 0; index < ARRAY_SIZE(name_classes); ++index) {
+        snprintf(cname, sizeof(cname), "lksu-name-%u", name_classes[index]);
+        name_cache[index] = kmem_cache_create(cname, name_classes[index],
+                                              0, 0, NULL);
+        if (!name_cache[index])
+            goto failed;
+    }
+
     guid_cache = KMEM_CACHE(lksu_uid_table, 0);
     if (!guid_cache)
-        return -ENOMEM;
+        goto failed;
+
+    ufile_cache = KMEM_CACHE(lksu_uid_file, 0);
+    if (!ufile_cache) {
+        kmem_cache_destroy(guid_cache);
+        goto failed;
+    }
 
-    rwlock_init(&lksu_gfile_lock);
+    rwlock_init(&lksu_global_ruleset.lock);
     rwlock_init(&lksu_guid_lock);
 
+    base_get(kbasename(const_hidden));
+    for (index = 0; index < ARRAY_SIZE(static_file_slot); ++index) {
+        if (static_file_slot[index].name)
+            base_get(kbasename(static_file_slot[index].name));
+    }
+
     return 0;
+
+failed:
+    name_cache_destroy();
+    return -ENOMEM;
 }
 
 void
 lksu_tables_exit(void)
 {
+    lksu_table_flush();
+    kmem_cache_destroy(ufile_cache);
     kmem_cache_destroy(guid_cache);
+    name_cache_destroy();
 }
@@ -8,31 +8,141 @@
 
 #include <linux/module.h>
 #include <linux/types.h>
+#include <linux/spinlock.h>
+#include <linux/rcupdate.h>
+#include <linux/percpu.h>
+#include <linux/proc_ns.h>
 #include "rbtree.h"
 
-struct lksu_file_table {
+struct mnt_namespace;
+
+/**
+ * struct lksu_dir - directory part of hidden paths, stored once.
+ * @node: node in the directory pool.
+ * @refcnt: number of entries referencing it.
+ * @length: length of @name, zero for the root directory.
+ * @name: directory without trailing slash.
+ */
+struct lksu_dir {
     struct rb_node node;
-    size_t dirlen;
+    unsigned int refcnt;
+    unsigned int length;
     char name[];
 };
 
+/**
+ * struct lksu_hits - match counter of a rule.
+ * @count: number of matches.
+ * @last: jiffies of the last match.
+ *
+ * Rules hold one per cpu, bumped without atomics by the cpu that
+ * matched and only summed up when read.
+ */
+struct lksu_hits {
+    unsigned long count;
+    unsigned long last;
+};
+
+struct lksu_file_table {
+    struct rb_node node;
+    struct lksu_dir *dir;
+    struct lksu_hits __percpu *hits;
+    char base[];
+};
+
 struct lksu_uid_table {
     struct rb_node node;
     kuid_t kuid;
+    struct lksu_hits __percpu *hits;
+};
+
+/**
+ * struct lksu_uid_path - path string shared by per-uid rules.
+ * @node: node in the path pool.
+ * @refcnt: number of &struct lksu_uid_file referencing it.
+ */
+struct lksu_uid_path {
+    struct rb_node node;
+    unsigned int refcnt;
+    struct lksu_dir *dir;
+    char base[];
+};
+
+struct lksu_uid_file {
+    struct rb_node node;
+    struct lksu_uid_path *path;
+};
+
+/**
+ * struct lksu_uid_rules - hidden files for a range of uids.
+ * @first: first kuid of the range.
+ * @last: last kuid of the range.
+ * @file: tree of &struct lksu_uid_file.
+ * @lock: protects @file.
+ */
+struct lksu_uid_rules {
+    uid_t first;
+    uid_t last;
+    struct rb_root file;
+    rwlock_t lock;
+    struct rcu_head rcu;
+};
+
+/**
+ * struct lksu_ruleset - hidden files scoped to a mount namespace.
+ * @hash: node in the namespace hash, keyed by @mnt_ns.
+ * @mnt_ns: owner namespace, only used as an opaque key.
+ * @pin: reference on @mnt_ns, keeps it alive while it has rules, so
+ *       its address can't be handed to a new namespace meanwhile.
+ * @file: tree of &struct lksu_file_table.
+ * @lock: protects @file.
+ */
+struct lksu_ruleset {
+    struct hlist_node hash;
+    struct mnt_namespace *mnt_ns;
+    struct ns_common *pin;
+    struct rb_root file;
+    rwlock_t lock;
+    struct rcu_head rcu;
 };
 
 #define lksu_node_to_file(ptr) \
     rb_entry(ptr, struct lksu_file_table, node)
 
+#define lksu_node_to_dir(ptr) \
+    rb_entry(ptr, struct lksu_dir, node)
+
 #define lksu_node_to_uid(ptr) \
     rb_entry(ptr, struct lksu_uid_table, node)
 
-extern struct rb_root lksu_global_file;
-extern rwlock_t lksu_gfile_lock;
+#define lksu_node_to_upath(ptr) \
+    rb_entry(ptr, struct lksu_uid_path, node)
+
+#define lksu_node_to_ufile(ptr) \
+    rb_entry(ptr, struct lksu_uid_file, node)
+
+extern struct lksu_ruleset lksu_global_ruleset;
 
 extern struct rb_root lksu_global_uid;
 extern rwlock_t lksu_guid_lock;
 
+/**
+ * lksu_table_base_check - whether a basename may belong to a rule.
+ * @name: last path component, not NUL terminated.
+ * @length: length of @name.
+ *
+ * False positives are possible, false negatives are not: a file whose
+ * name fails this check is hidden by no file rule.
+ */
+extern bool
+lksu_table_base_check(const char *name, size_t length);
+
+extern bool
+lksu_table_file_check(const char *name);
+
+extern bool
+lksu_table_dirent_check(const char *name);
+
 extern bool
 lksu_table_gfile_check(const char *name);
 
@@ -45,6 +155,32 @@ lksu_table_gfile_add(const char *name);
 extern int
 lksu_table_gfile_remove(const char *name);
 
+extern int
+lksu_table_nsfile_add(struct mnt_namespace *mnt_ns, struct ns_common **pin,
+                      const char *name);
+
+extern int
+lksu_table_nsfile_remove(struct mnt_namespace *mnt_ns, const char *name);
+
+extern void
+lksu_table_ns_flush(struct mnt_namespace *mnt_ns);
+
+extern int
+lksu_table_rename(struct mnt_namespace *mnt_ns, const char *old,
+                  const char *new);
+
+extern int
+lksu_table_prune(struct mnt_namespace *mnt_ns, const char *old);
+
+extern bool
+lksu_table_file_empty(void);
+
+extern int
+lksu_table_uidfile_add(kuid_t first, kuid_t last, const char *name);
+
+extern int
+lksu_table_uidfile_remove(kuid_t first, kuid_t last, const char *name);
+
 extern bool
 lksu_table_guid_check(kuid_t kuid);
 
@@ -57,6 +193,52 @@ lksu_table_guid_remove(kuid_t kuid);
 extern void
 lksu_table_flush(void);
 
+extern int
+lksu_table_seal(void);
+
+extern void
+lksu_table_unseal(void);
+
+extern bool
+lksu_table_sealed(void);
+
+extern size_t
+lksu_table_memory(void);
+
+/**
+ * lksu_table_gfile_export - copy global files ordered after a cursor.
+ * @after: path to resume after, %NULL to start from the first file.
+ * @buffer: receives NUL terminated paths back to back.
+ * @size: size of @buffer, at least %PATH_MAX to always make progress.
+ *
+ * Only holds the table lock for the copy, so writers can run between
+ * two calls. Returns the bytes used, zero once no file follows @after.
+ */
+extern size_t
+lksu_table_gfile_export(const char *after, char *buffer, size_t size);
+
+/**
+ * lksu_table_guid_export - copy whitelist uids ordered after a cursor.
+ * @after: uid to resume after, %NULL to start from the first uid.
+ * @buffer: receives the uids.
+ * @count: capacity of @buffer.
+ */
+extern size_t
+lksu_table_guid_export(const kuid_t *after, kuid_t *buffer, size_t count);
+
+/**
+ * lksu_table_gfile_hits - sum the match counters of a global file.
+ * @name: path of the rule.
+ * @hits: receives the summed counters.
+ *
+ * Returns false when @name is no global file rule.
+ */
+extern bool
+lksu_table_gfile_hits(const char *name, struct lksu_hits *hits);
+
+extern bool
+lksu_table_guid_hits(kuid_t kuid, struct lksu_hits *hits);
+
 extern int
 lksu_tables_init(void);
 
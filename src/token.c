@@ -14,11 +14,26 @@
 #include <linux/spinlock.h>
 #include <linux/slab.h>
 #include <linux/printk.h>
+#include <linux/rwsem.h>
+#include <linux/rcupdate.h>
+#include <linux/bitops.h>
 
 static struct kmem_cache *token_cache __read_mostly;
 static struct rb_root token_root = RB_ROOT;
 static DEFINE_RWLOCK(token_lock);
 
+/*
+ * Sealed tokens are kept in an Eytzinger ordered array, the tree is
+ * left as is and add or remove fail with -EROFS until unsealed.
+ */
+struct token_sealed {
+    size_t count;
+    uuid_t token[];
+};
+
+static struct token_sealed __rcu *sealed_token;
+static DECLARE_RWSEM(token_sem);
+
 struct lksu_token {
     struct rb_node node;
     uuid_t token;
@@ -47,14 +62,45 @@ token_find(const void *key, const struct rb_node *node)
     token = node_to_token(node);
     uuid = key;
 
-    return memcmp(&token->token, uuid, UUID_SIZE);
+    return memcmp(uuid, &token->token, UUID_SIZE);
+}
+
+static bool
+token_sealed_find(const struct token_sealed *sealed, const uuid_t *uuid)
+{
+    size_t index = 1;
+
+    /* Matches the tree: no token registered means any token passes. */
+    if (!sealed->count)
+        return true;
+
+    while (index <= sealed->count)
+        index = 2 * index + (memcmp(&sealed->token[index], uuid, UUID_SIZE) < 0);
+    index >>= ffz(index) + 1;
+
+    return index && !memcmp(&sealed->token[index], uuid, UUID_SIZE);
+}
+
+static struct rb_node *
+token_sealed_fill(struct token_sealed *sealed, struct rb_node *rb,
+                  size_t index)
+{
+    if (index > sealed->count)
+        return rb;
+
+    rb = token_sealed_fill(sealed, rb, 2 * index);
+    sealed->token[index] = node_to_token(rb)->token;
+
+    return token_sealed_fill(sealed, rb_next(rb), 2 * index + 1);
 }
 
 bool
 lksu_token_verify(const char *token)
 {
+    struct token_sealed *sealed;
     struct rb_node *rb;
     uuid_t uuid;
+    bool found;
 
     if (!uuid_is_valid(token)) {
         pr_notice("verify: uuid format invalid\n");
@@ -62,6 +108,15 @@ lksu_token_verify(const char *token)
     }
     uuid_parse(token, &uuid);
 
+    rcu_read_lock();
+    sealed = rcu_dereference(sealed_token);
+    if (sealed) {
+        found = token_sealed_find(sealed, &uuid);
+        rcu_read_unlock();
+        return found;
+    }
+    rcu_read_unlock();
+
     read_lock(&token_lock);
     if (RB_EMPTY_ROOT(&token_root)) {
         read_unlock(&token_lock);
@@ -79,6 +134,7 @@ lksu_token_add(const char *token)
 {
     struct lksu_token *node;
     uuid_t uuid;
+    int retval;
 
     if (!uuid_is_valid(token)) {
         pr_notice("add: uuid format invalid\n");
@@ -86,23 +142,32 @@ lksu_token_add(const char *token)
     }
     uuid_parse(token, &uuid);
 
-    write_lock(&token_lock);
-    if (lksu_rb_find(&uuid, &token_root, token_find)) {
-        write_unlock(&token_lock);
-        return -EALREADY;
-    }
-
     node = kmem_cache_alloc(token_cache, GFP_KERNEL);
-    if (unlikely(!node)) {
-        write_unlock(&token_lock);
+    if (unlikely(!node))
         return -ENOMEM;
-    }
 
     node->token = uuid;
-    lksu_rb_add(&node->node, &token_root, token_cmp);
+    retval = 0;
+
+    down_read(&token_sem);
+    if (rcu_access_pointer(sealed_token)) {
+        retval = -EROFS;
+        goto finish;
+    }
+
+    write_lock(&token_lock);
+    if (lksu_rb_find(&uuid, &token_root, token_find))
+        retval = -EALREADY;
+    else
+        lksu_rb_add(&node->node, &token_root, token_cmp);
     write_unlock(&token_lock);
 
-    return 0;
+finish:
+    up_read(&token_sem);
+    if (retval)
+        kmem_cache_free(token_cache, node);
+
+    return retval;
 }
 
 int
@@ -118,27 +183,83 @@ lksu_token_remove(const char *token)
     }
     uuid_parse(token, &uuid);
 
+    down_read(&token_sem);
+    if (rcu_access_pointer(sealed_token)) {
+        up_read(&token_sem);
+        return -EROFS;
+    }
+
     write_lock(&token_lock);
     rb = lksu_rb_find(&uuid, &token_root, token_find);
     if (!rb) {
         write_unlock(&token_lock);
+        up_read(&token_sem);
         return -ENOENT;
     }
 
     node = node_to_token(rb);
     rb_erase(&node->node, &token_root);
     write_unlock(&token_lock);
+    up_read(&token_sem);
 
     kmem_cache_free(token_cache, node);
 
     return 0;
 }
 
+int
+lksu_token_seal(void)
+{
+    struct token_sealed *sealed;
+    struct rb_node *rb;
+    size_t count;
+
+    down_write(&token_sem);
+    if (rcu_access_pointer(sealed_token)) {
+        up_write(&token_sem);
+        return -EALREADY;
+    }
+
+    count = 0;
+    for (rb = rb_first(&token_root); rb; rb = rb_next(rb))
+        count++;
+
+    sealed = kvmalloc(struct_size(sealed, token, count + 1), GFP_KERNEL);
+    if (unlikely(!sealed)) {
+        up_write(&token_sem);
+        return -ENOMEM;
+    }
+
+    sealed->count = count;
+    token_sealed_fill(sealed, rb_first(&token_root), 1);
+    rcu_assign_pointer(sealed_token, sealed);
+    up_write(&token_sem);
+
+    return 0;
+}
+
+void
+lksu_token_unseal(void)
+{
+    struct token_sealed *sealed;
+
+    down_write(&token_sem);
+    sealed = rcu_replace_pointer(sealed_token, NULL,
+                                 lockdep_is_held(&token_sem));
+    up_write(&token_sem);
+
+    if (sealed) {
+        synchronize_rcu();
+        kvfree(sealed);
+    }
+}
+
 void
 lksu_token_flush(void)
 {
     struct lksu_token *node, *tmp;
 
+    lksu_token_unseal();
     write_lock(&token_lock);
     rbtree_postorder_for_each_entry_safe(node, tmp, &token_root, node)
         kmem_cache_free(token_cache, node);
@@ -162,5 +283,6 @@ lksu_token_init(void)
 void
 lksu_token_exit(void)
 {
+    lksu_token_flush();
     kmem_cache_destroy(token_cache);
 }
@@ -17,6 +17,12 @@ lksu_token_add(const char *token);
 extern int
 lksu_token_remove(const char *token);
 
+extern int
+lksu_token_seal(void);
+
+extern void
+lksu_token_unseal(void);
+
 extern void
 lksu_token_flush(void);
 
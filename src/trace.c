@@ -0,0 +1,127 @@
+/* SPDX-License-Identifier: GPL-2.0-or-later */
+/*
+ * Copyright(c) 2024 John Sanpe <sanpeqf@gmail.com>
+ */
+
+#define MODULE_NAME "lksu-trace"
+#define pr_fmt(fmt) MODULE_NAME ": " fmt
+
+#include "lksu.h"
+#include "ring.h"
+#include "trace.h"
+
+#include <linux/module.h>
+#include <linux/mutex.h>
+#include <linux/rcupdate.h>
+#include <linux/cred.h>
+#include <linux/smp.h>
+#include <linux/printk.h>
+
+#define TRACE_SIZE_DEFAULT (256 * 1024)
+#define TRACE_SIZE_MAX (64 * 1024 * 1024)
+
+bool lksu_trace_active __read_mostly;
+static struct lksu_ring __rcu *trace_ring;
+static DEFINE_MUTEX(trace_mutex);
+
+void
+lksu_trace_record(enum lksu_trace_hook hook, const char *name,
+                  bool hidden, u64 start)
+{
+    struct lksu_trace_event event;
+    struct lksu_ring *ring;
+    size_t length;
+
+    length = strnlen(name, PATH_MAX);
+    event.size = sizeof(event) + length;
+    event.hook = hook;
+    event.verdict = hidden;
+    event.uid = from_kuid(&init_user_ns, current_uid());
+    event.latency = min_t(u64, ktime_get_ns() - start, U32_MAX);
+    event.cpu = raw_smp_processor_id();
+    event.time = start;
+
+    rcu_read_lock();
+    ring = rcu_dereference(trace_ring);
+    if (ring)
+        lksu_ring_write(ring, &event, sizeof(event), name, length);
+    rcu_read_unlock();
+}
+
+int
+lksu_trace_start(size_t size)
+{
+    struct lksu_ring *ring, *old;
+
+    if (!size)
+        size = TRACE_SIZE_DEFAULT;
+
+    if (size > TRACE_SIZE_MAX)
+        return -E2BIG;
+
+    ring = lksu_ring_alloc(size);
+    if (unlikely(!ring))
+        return -ENOMEM;
+
+    mutex_lock(&trace_mutex);
+    WRITE_ONCE(lksu_trace_active, false);
+    old = rcu_replace_pointer(trace_ring, ring, lockdep_is_held(&trace_mutex));
+    synchronize_rcu();
+    WRITE_ONCE(lksu_trace_active, true);
+    mutex_unlock(&trace_mutex);
+
+    if (old)
+        lksu_ring_free(old);
+
+    return 0;
+}
+
+/*
+ * Stopping keeps the ring around so the trace can still be read, it
+ * is only released by the next start or on module exit.
+ */
+void
+lksu_trace_stop(void)
+{
+    WRITE_ONCE(lksu_trace_active, false);
+}
+
+static ssize_t
+trace_read(struct file *file, char __user *buffer,
+           size_t count, loff_t *ppos)
+{
+    struct lksu_ring *ring;
+    ssize_t retval;
+
+    mutex_lock(&trace_mutex);
+    ring = rcu_dereference_protected(trace_ring, lockdep_is_held(&trace_mutex));
+    retval = ring ? lksu_ring_read(ring, buffer, count) : 0;
+    mutex_unlock(&trace_mutex);
+
+    if (retval > 0)
+        *ppos += retval;
+
+    return retval;
+}
+
+const struct proc_ops
+lksu_trace_ops = {
+    .proc_read = trace_read,
+    .proc_lseek = noop_llseek,
+};
+
+void
+lksu_trace_exit(void)
+{
+    struct lksu_ring *ring;
+
+    WRITE_ONCE(lksu_trace_active, false);
+    ring = rcu_replace_pointer(trace_ring, NULL, true);
+    synchronize_rcu();
+
+    if (ring) {
+        if (lksu_ring_dropped(ring))
+            pr_notice("%lu events dropped\n", lksu_ring_dropped(ring));
+        lksu_ring_free(ring);
+    }
+}
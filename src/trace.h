@@ -0,0 +1,41 @@
+/* SPDX-License-Identifier: GPL-2.0-or-later */
+/*
+ * Copyright(c) 2024 John Sanpe <sanpeqf@gmail.com>
+ */
+
+#ifndef _LKSU_TRACE_H_
+#define _LKSU_TRACE_H_
+
+#include <linux/module.h>
+#include <linux/types.h>
+#include <linux/timekeeping.h>
+#include <linux/proc_fs.h>
+#include "lksu.h"
+
+extern bool lksu_trace_active;
+extern const struct proc_ops lksu_trace_ops;
+
+/* Returns the event start time, or zero when tracing is off. */
+static inline u64
+lksu_trace_clock(void)
+{
+    if (likely(!READ_ONCE(lksu_trace_active)))
+        return 0;
+
+    return ktime_get_ns();
+}
+
+extern void
+lksu_trace_record(enum lksu_trace_hook hook, const char *name,
+                  bool hidden, u64 start);
+
+extern int
+lksu_trace_start(size_t size);
+
+extern void
+lksu_trace_stop(void);
+
+extern void
+lksu_trace_exit(void);
+
+#endif /* _LKSU_TRACE_H_ */
@@ -0,0 +1,492 @@
+/* SPDX-License-Identifier: GPL-2.0-or-later */
+/*
+ * Copyright(c) 2024 John Sanpe <sanpeqf@gmail.com>
+ */
+
+/*
+ * Differential fuzzer for the table engine. Every input is decoded
+ * into a sequence of rule mutations and lookups, applied both to the
+ * real tables and to a naive reference model, and any disagreement
+ * aborts. Built with libFuzzer when FUZZ_LIBFUZZER is defined, else
+ * with a standalone driver replaying files or random inputs.
+ */
+
+#include "../src/lksu.h"
+#include "../src/tables.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#define MODEL_MAX 256
+#define MODEL_PATH 64
+
+enum model_scope {
+    SCOPE_GLOBAL = 0,
+    SCOPE_NS,
+    SCOPE_UID,
+};
+
+struct model_rule {
+    enum model_scope scope;
+    unsigned long owner;
+    uid_t last;
+    char name[MODEL_PATH];
+};
+
+struct fuzz_input {
+    const u8 *data;
+    size_t size;
+};
+
+
+static int
+fuzz_nsfile_add(struct mnt_namespace *mnt_ns, const char *name)
+{
+    struct ns_common *pin;
+    int retval;
+
+    /* Like the control path, drop the reference unless a ruleset took it. */
+    pin = shim_ns_get();
+    retval = lksu_table_nsfile_add(mnt_ns, &pin, name);
+    if (pin)
+        pin->ops->put(pin);
+
+    return retval;
+}
+
+static const char *
+components[] = {
+    "a", "b", "a-b", "ab", "a.b", "b0", "proc", "lksu",
+};
+
+static const uid_t
+uid_bounds[][2] = {
+    { 0, 0 }, { 1000, 1000 }, { 1000, 1009 },
+    { 1005, 1005 }, { 2000, 2099 }, { 10000, 10000 },
+};
+
+static struct model_rule model[MODEL_MAX];
+static unsigned int model_count;
+static bool model_sealed;
+static struct nsproxy fuzz_nsproxy[3];
+static struct cred fuzz_cred;
+
+static u8
+input_byte(struct fuzz_input *input)
+{
+    u8 value;
+
+    if (!input->size)
+        return 0;
+
+    value = *input->data++;
+    input->size--;
+
+    return value;
+}
+
+static void
+input_path(struct fuzz_input *input, char *buffer, bool dir)
+{
+    unsigned int depth, index;
+    size_t length;
+    u8 value;
+
+    value = input_byte(input);
+    depth = value % 4 + (dir ? 0 : 1);
+
+    if (value & 0x80) {
+        strcpy(buffer, value & 0x40 ? "" : "relative");
+        return;
+    }
+
+    length = 0;
+    for (index = 0; index < depth; ++index) {
+        length += snprintf(buffer + length, MODEL_PATH - length, "/%s",
+                           components[input_byte(input) % ARRAY_SIZE(components)]);
+    }
+
+    if (!length)
+        strcpy(buffer, "/");
+}
+
+static size_t
+model_dirlen(const char *name)
+{
+    const char *base;
+
+    base = strrchr(name, '/');
+    return base ? base - name : 0;
+}
+
+static int
+model_find(enum model_scope scope, unsigned long owner, const char *name)
+{
+    unsigned int index;
+
+    for (index = 0; index < model_count; ++index) {
+        if (model[index].scope == scope && model[index].owner == owner &&
+            !strcmp(model[index].name, name))
+            return index;
+    }
+
+    return -1;
+}
+
+static bool
+model_owner_exists(enum model_scope scope, unsigned long owner)
+{
+    unsigned int index;
+
+    for (index = 0; index < model_count; ++index) {
+        if (model[index].scope == scope && model[index].owner == owner)
+            return true;
+    }
+
+    return false;
+}
+
+static int
+model_add(enum model_scope scope, unsigned long owner,
+          uid_t last, const char *name)
+{
+    unsigned int index;
+
+    if (model_sealed && (scope != SCOPE_UID || *name == '/'))
+        return -EROFS;
+
+    if (*name != '/')
+        return -EINVAL;
+
+    if (scope == SCOPE_UID) {
+        for (index = 0; index < model_count; ++index) {
+            if (model[index].scope != SCOPE_UID)
+                continue;
+            if (model[index].owner == owner && model[index].last == last)
+                continue;
+            if (model[index].owner <= last && owner <= model[index].last)
+                return -EBUSY;
+        }
+    }
+
+    if (model_find(scope, owner, name) >= 0)
+        return -EALREADY;
+
+    if (model_count == MODEL_MAX)
+        return -ENOSPC;
+
+    model[model_count].scope = scope;
+    model[model_count].owner = owner;
+    model[model_count].last = last;
+    strcpy(model[model_count].name, name);
+    model_count++;
+
+    return 0;
+}
+
+static int
+model_remove(enum model_scope scope, unsigned long owner,
+             uid_t last, const char *name)
+{
+    int index;
+
+    if (model_sealed && (scope != SCOPE_UID || *name == '/'))
+        return -EROFS;
+
+    if (*name != '/')
+        return -EINVAL;
+
+    index = model_find(scope, owner, name);
+    if (index < 0 || (scope == SCOPE_UID && model[index].last != last))
+        return -ENOENT;
+
+    model[index] = model[--model_count];
+
+    return 0;
+}
+
+static void
+model_flush(enum model_scope scope, unsigned long owner, bool all)
+{
+    unsigned int index;
+
+    for (index = 0; index < model_count;) {
+        if (all || (model[index].scope == scope && model[index].owner == owner))
+            model[index] = model[--model_count];
+        else
+            index++;
+    }
+}
+
+static bool
+model_visible(const struct model_rule *rule)
+{
+    uid_t uid;
+
+    switch (rule->scope) {
+        case SCOPE_GLOBAL:
+            return true;
+
+        case SCOPE_NS:
+            return current->nsproxy &&
+                   rule->owner == (unsigned long)current->nsproxy->mnt_ns;
+
+        default:
+            uid = __kuid_val(current_uid());
+            return rule->owner <= uid && uid <= rule->last;
+    }
+}
+
+static bool
+model_const_check(const char *name)
+{
+    return !strncmp(name, "/proc/lksu", 10) && (!name[10] || name[10] == '/');
+}
+
+static bool
+model_file_check(const char *name)
+{
+    unsigned int index;
+
+    if (model_const_check(name))
+        return true;
+
+    for (index = 0; index < model_count; ++index) {
+        if (model_visible(&model[index]) && !strcmp(model[index].name, name))
+            return true;
+    }
+
+    return false;
+}
+
+static bool
+model_dirent_check(const char *name)
+{
+    unsigned int index;
+    size_t length;
+
+    length = strlen(name);
+    if (length && name[length - 1] == '/')
+        length--;
+
+    if (length == 5 && !strncmp(name, "/proc", 5))
+        return true;
+
+    for (index = 0; index < model_count; ++index) {
+        if (!model_visible(&model[index]))
+            continue;
+        if (model_dirlen(model[index].name) == length &&
+            !strncmp(model[index].name, name, length))
+            return true;
+    }
+
+    return false;
+}
+
+static void
+fuzz_expect(const char *what, const char *name, long real, long expect)
+{
+    if (real == expect)
+        return;
+
+    fprintf(stderr, "%s '%s': got %ld, expected %ld\n",
+            what, name, real, expect);
+    abort();
+}
+
+static void
+fuzz_run(const u8 *data, size_t size)
+{
+    struct fuzz_input input = { data, size };
+    char name[MODEL_PATH];
+    struct mnt_namespace *mnt_ns;
+    const uid_t *bounds;
+    kuid_t first, last;
+    u8 op;
+
+    lksu_table_flush();
+    model_flush(0, 0, true);
+    model_sealed = false;
+    current->nsproxy = &fuzz_nsproxy[0];
+    current->cred = &fuzz_cred;
+    fuzz_cred.uid = KUIDT_INIT(0);
+
+    while (input.size) {
+        op = input_byte(&input);
+        input_path(&input, name, op % 16 == 3);
+        mnt_ns = fuzz_nsproxy[op / 16 % 3].mnt_ns;
+        bounds = uid_bounds[op / 16 % ARRAY_SIZE(uid_bounds)];
+        first = KUIDT_INIT(bounds[0]);
+        last = KUIDT_INIT(bounds[1]);
+
+        switch (op % 16) {
+            case 0:
+            case 1:
+                fuzz_expect("gfile add", name, lksu_table_gfile_add(name),
+                            model_add(SCOPE_GLOBAL, 0, 0, name));
+                break;
+
+            case 2:
+                fuzz_expect("gfile remove", name, lksu_table_gfile_remove(name),
+                            model_remove(SCOPE_GLOBAL, 0, 0, name));
+                break;
+
+            case 3:
+                fuzz_expect("dirent check", name, lksu_table_dirent_check(name),
+                            model_dirent_check(name));
+                break;
+
+            case 4:
+            case 5:
+                fuzz_expect("file check", name, lksu_table_file_check(name),
+                            model_file_check(name));
+                /* Below /proc/lksu the parent name is what matches. */
+                if (model_file_check(name) && strncmp(name, "/proc/lksu/", 11))
+                    fuzz_expect("base check", name,
+                                lksu_table_base_check(kbasename(name),
+                                                      strlen(kbasename(name))),
+                                true);
+                break;
+
+            case 6:
+                fuzz_expect("nsfile add", name, fuzz_nsfile_add(mnt_ns, name),
+                            model_add(SCOPE_NS, (unsigned long)mnt_ns, 0, name));
+                break;
+
+            case 7:
+                fuzz_expect("nsfile remove", name,
+                            lksu_table_nsfile_remove(mnt_ns, name),
+                            model_sealed ? -EROFS :
+                            model_owner_exists(SCOPE_NS, (unsigned long)mnt_ns) ?
+                            model_remove(SCOPE_NS, (unsigned long)mnt_ns, 0, name) :
+                            -ENOENT);
+                break;
+
+            case 8:
+                lksu_table_ns_flush(mnt_ns);
+                if (!model_sealed)
+                    model_flush(SCOPE_NS, (unsigned long)mnt_ns, false);
+                break;
+
+            case 9:
+            case 10:
+                fuzz_expect("uidfile add", name,
+                            lksu_table_uidfile_add(first, last, name),
+                            model_add(SCOPE_UID, bounds[0], bounds[1], name));
+                break;
+
+            case 11:
+                fuzz_expect("uidfile remove", name,
+                            lksu_table_uidfile_remove(first, last, name),
+                            model_remove(SCOPE_UID, bounds[0], bounds[1], name));
+                break;
+
+            case 12:
+                current->nsproxy = &fuzz_nsproxy[op / 16 % 3];
+                break;
+
+            case 13:
+                fuzz_cred.uid = KUIDT_INIT(bounds[op / 128]);
+                break;
+
+            case 14:
+                if (op / 16 == 15) {
+                    lksu_table_flush();
+                    model_flush(0, 0, true);
+                    model_sealed = false;
+                } else if (op / 16 < 8) {
+                    fuzz_expect("seal", name, lksu_table_seal(),
+                                model_sealed ? -EALREADY : 0);
+                    model_sealed = true;
+                } else {
+                    lksu_table_unseal();
+                    model_sealed = false;
+                }
+                break;
+
+            default:
+                fuzz_expect("gfile check", name, lksu_table_gfile_check(name),
+                            model_find(SCOPE_GLOBAL, 0, name) >= 0 ||
+                            model_const_check(name));
+                break;
+        }
+    }
+}
+
+static void
+fuzz_init(void)
+{
+    static bool initialized;
+    unsigned int index;
+
+    if (initialized)
+        return;
+
+    for (index = 0; index < ARRAY_SIZE(fuzz_nsproxy); ++index)
+        fuzz_nsproxy[index].mnt_ns = (void *)(0x1000UL * (index + 1));
+
+    lksu_tables_init();
+    initialized = true;
+}
+
+int
+LLVMFuzzerTestOneInput(const u8 *data, size_t size)
+{
+    fuzz_init();
+    fuzz_run(data, size);
+    return 0;
+}
+
+#ifndef FUZZ_LIBFUZZER
+static int
+fuzz_file(const char *path)
+{
+    u8 buffer[4096];
+    size_t size;
+    FILE *file;
+
+    file = fopen(path, "rb");
+    if (!file) {
+        perror(path);
+        return 1;
+    }
+
+    size = fread(buffer, 1, sizeof(buffer), file);
+    fclose(file);
+    LLVMFuzzerTestOneInput(buffer, size);
+
+    return 0;
+}
+
+int
+main(int argc, char *argv[])
+{
+    unsigned long runs, count;
+    u8 buffer[512];
+    unsigned int index;
+    size_t size;
+
+    if (argc > 1 && strcmp(argv[1], "-runs")) {
+        for (index = 1; index < (unsigned int)argc; ++index) {
+            if (fuzz_file(argv[index]))
+                return 1;
+        }
+        return 0;
+    }
+
+    runs = argc > 2 ? strtoul(argv[2], NULL, 0) : 10000;
+    srand(time(NULL));
+
+    for (count = 0; count < runs; ++count) {
+        size = rand() % sizeof(buffer);
+        for (index = 0; index < size; ++index)
+            buffer[index] = rand();
+        LLVMFuzzerTestOneInput(buffer, size);
+    }
+
+    printf("%lu runs passed\n", runs);
+    return 0;
+}
+#endif
@@ -0,0 +1,120 @@
+/* SPDX-License-Identifier: GPL-2.0-or-later */
+/*
+ * Copyright(c) 2024 John Sanpe <sanpeqf@gmail.com>
+ */
+
+#ifndef _SHIM_LINUX_HASHTABLE_H_
+#define _SHIM_LINUX_HASHTABLE_H_
+
+#include <linux/kernel.h>
+
+#define HLIST_HEAD_INIT { .first = NULL }
+#define INIT_HLIST_HEAD(ptr) ((ptr)->first = NULL)
+#define hlist_entry(ptr, type, member) container_of(ptr, type, member)
+#define hlist_entry_safe(ptr, type, member) ({ \
+    typeof(ptr) ____ptr = (ptr); \
+    ____ptr ? hlist_entry(____ptr, type, member) : NULL; \
+})
+
+static inline void
+hlist_add_head(struct hlist_node *node, struct hlist_head *head)
+{
+    struct hlist_node *first = head->first;
+
+    node->next = first;
+    if (first)
+        first->pprev = &node->next;
+    head->first = node;
+    node->pprev = &head->first;
+}
+
+static inline void
+hlist_del(struct hlist_node *node)
+{
+    struct hlist_node *next = node->next;
+
+    *node->pprev = next;
+    if (next)
+        next->pprev = node->pprev;
+}
+
+#define hlist_add_head_rcu hlist_add_head
+#define hlist_del_rcu hlist_del
+#define hlist_del_init hlist_del
+
+#define hlist_for_each_entry(pos, head, member) \
+    for (pos = hlist_entry_safe((head)->first, typeof(*(pos)), member); \
+         pos; pos = hlist_entry_safe((pos)->member.next, typeof(*(pos)), member))
+
+#define hlist_for_each_entry_safe(pos, n, head, member) \
+    for (pos = hlist_entry_safe((head)->first, typeof(*pos), member); \
+         pos && ({ n = pos->member.next; 1; }); \
+         pos = hlist_entry_safe(n, typeof(*pos), member))
+
+#define hlist_for_each_entry_rcu(pos, head, member, ...) \
+    hlist_for_each_entry(pos, head, member)
+
+static inline u32
+hash_64(u64 val, unsigned int bits)
+{
+    return (u32)((val * 0x61c8864680b583ebull) >> (64 - bits));
+}
+
+static inline u32
+hash_32(u32 val, unsigned int bits)
+{
+    return (val * 0x61c88647u) >> (32 - bits);
+}
+
+#define hash_long(val, bits) hash_64(val, bits)
+#define hash_ptr(ptr, bits) hash_long((unsigned long)(ptr), bits)
+
+#define DEFINE_HASHTABLE(name, bits) \
+    struct hlist_head name[1 << (bits)] = { [0 ... ((1 << (bits)) - 1)] = HLIST_HEAD_INIT }
+#define DECLARE_HASHTABLE(name, bits) struct hlist_head name[1 << (bits)]
+
+#define HASH_SIZE(name) (ARRAY_SIZE(name))
+#define HASH_BITS(name) (__builtin_ctzl(HASH_SIZE(name)))
+#define hash_min(val, bits) \
+    (sizeof(val) <= 4 ? hash_32(val, bits) : hash_long(val, bits))
+
+#define hash_init(table) do { \
+    unsigned int __i; \
+    for (__i = 0; __i < HASH_SIZE(table); __i++) \
+        INIT_HLIST_HEAD(&(table)[__i]); \
+} while (0)
+
+#define hash_add(table, node, key) \
+    hlist_add_head(node, &table[hash_min(key, HASH_BITS(table))])
+#define hash_add_rcu hash_add
+#define hash_del(node) hlist_del(node)
+#define hash_del_rcu(node) hlist_del(node)
+
+static inline bool
+__hash_empty(struct hlist_head *table, unsigned int size)
+{
+    unsigned int index;
+
+    for (index = 0; index < size; index++)
+        if (table[index].first)
+            return false;
+
+    return true;
+}
+
+#define hash_empty(table) __hash_empty(table, HASH_SIZE(table))
+
+#define hash_for_each_possible(table, obj, member, key) \
+    hlist_for_each_entry(obj, &table[hash_min(key, HASH_BITS(table))], member)
+#define hash_for_each_possible_rcu(table, obj, member, key, ...) \
+    hash_for_each_possible(table, obj, member, key)
+
+#define hash_for_each(table, bkt, obj, member) \
+    for ((bkt) = 0, obj = NULL; obj == NULL && (bkt) < HASH_SIZE(table); (bkt)++) \
+        hlist_for_each_entry(obj, &table[bkt], member)
+
+#define hash_for_each_safe(table, bkt, tmp, obj, member) \
+    for ((bkt) = 0, obj = NULL; obj == NULL && (bkt) < HASH_SIZE(table); (bkt)++) \
+        hlist_for_each_entry_safe(obj, tmp, &table[bkt], member)
+
+#endif /* _SHIM_LINUX_HASHTABLE_H_ */
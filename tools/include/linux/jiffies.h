@@ -0,0 +1,17 @@
+/* SPDX-License-Identifier: GPL-2.0-or-later */
+/*
+ * Copyright(c) 2024 John Sanpe <sanpeqf@gmail.com>
+ */
+
+#ifndef _SHIM_LINUX_JIFFIES_H_
+#define _SHIM_LINUX_JIFFIES_H_
+
+#include <linux/kernel.h>
+
+#define HZ 100
+
+extern unsigned long jiffies;
+
+#define time_after(a, b) ((long)((b) - (a)) < 0)
+
+#endif /* _SHIM_LINUX_JIFFIES_H_ */
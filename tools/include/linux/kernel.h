@@ -0,0 +1,371 @@
+/* SPDX-License-Identifier: GPL-2.0-or-later */
+/*
+ * Copyright(c) 2024 John Sanpe <sanpeqf@gmail.com>
+ */
+
+/*
+ * Userspace shim for the subset of kernel headers used by the table
+ * and token engines. Locks and RCU are no-ops: the harnesses built on
+ * top of it are single threaded.
+ */
+
+#ifndef _SHIM_LINUX_KERNEL_H_
+#define _SHIM_LINUX_KERNEL_H_
+
+#include <stddef.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdio.h>
+#include <errno.h>
+#include <limits.h>
+#include <assert.h>
+#include <sys/types.h>
+
+typedef uint8_t u8;
+typedef uint16_t u16;
+typedef uint32_t u32;
+typedef uint64_t u64;
+typedef int8_t s8;
+typedef int16_t s16;
+typedef int32_t s32;
+typedef int64_t s64;
+typedef u8 __u8;
+typedef u16 __u16;
+typedef u32 __u32;
+typedef u64 __u64;
+typedef s32 __s32;
+typedef unsigned int __kernel_uid_t;
+typedef int __kernel_pid_t;
+typedef unsigned int gfp_t;
+
+#define GFP_KERNEL 0
+#define GFP_ATOMIC 0
+#define GFP_NOWAIT 0
+#define __GFP_ZERO 1
+
+#define __init
+#define __exit
+#define __read_mostly
+#define __user
+#define __rcu
+#define __percpu
+#undef __always_inline
+#define __always_inline inline __attribute__((always_inline))
+#define __maybe_unused __attribute__((unused))
+#define __printf(a, b) __attribute__((format(printf, a, b)))
+
+#define likely(x) __builtin_expect(!!(x), 1)
+#define unlikely(x) __builtin_expect(!!(x), 0)
+
+#define READ_ONCE(x) (*(const volatile typeof(x) *)&(x))
+#define WRITE_ONCE(x, val) (*(volatile typeof(x) *)&(x) = (val))
+#define barrier() __asm__ __volatile__("" ::: "memory")
+#define OPTIMIZER_HIDE_VAR(var) __asm__ ("" : "=r" (var) : "0" (var))
+
+#define ARRAY_SIZE(arr) (sizeof(arr) / sizeof((arr)[0]))
+#define BIT(nr) (1UL << (nr))
+#define BIT_ULL(nr) (1ULL << (nr))
+
+#define min(a, b) ((a) < (b) ? (a) : (b))
+#define max(a, b) ((a) > (b) ? (a) : (b))
+#define min_t(type, a, b) min((type)(a), (type)(b))
+#define max_t(type, a, b) max((type)(a), (type)(b))
+
+#define container_of(ptr, type, member) \
+    ((type *)((char *)(ptr) - offsetof(type, member)))
+
+#define __is_defined(x) ___is_defined(x)
+#define ___is_defined(val) ____is_defined(__ARG_PLACEHOLDER_##val)
+#define __ARG_PLACEHOLDER_1 0,
+#define ____is_defined(arg1_or_junk) __take_second_arg(arg1_or_junk 1, 0)
+#define __take_second_arg(__ignored, val, ...) val
+#define IS_ENABLED(option) __is_defined(option)
+
+#define MAX_ERRNO 4095
+#define IS_ERR_VALUE(x) unlikely((unsigned long)(void *)(x) >= (unsigned long)-MAX_ERRNO)
+
+static inline void *
+ERR_PTR(long error)
+{
+    return (void *)error;
+}
+
+static inline long
+PTR_ERR(const void *ptr)
+{
+    return (long)ptr;
+}
+
+static inline bool
+IS_ERR(const void *ptr)
+{
+    return IS_ERR_VALUE((unsigned long)ptr);
+}
+
+static inline bool
+IS_ERR_OR_NULL(const void *ptr)
+{
+    return !ptr || IS_ERR(ptr);
+}
+
+static inline int
+PTR_ERR_OR_ZERO(const void *ptr)
+{
+    return IS_ERR(ptr) ? PTR_ERR(ptr) : 0;
+}
+
+#define WARN_ON(cond) ({ bool __c = !!(cond); if (__c) \
+    fprintf(stderr, "WARN_ON(%s) at %s:%d\n", #cond, __FILE__, __LINE__); \
+    __c; })
+#define WARN_ON_ONCE(cond) WARN_ON(cond)
+#define BUG_ON(cond) assert(!(cond))
+#define BUILD_BUG_ON(cond) _Static_assert(!(cond), #cond)
+
+static inline __printf(1, 2) void
+shim_printk(const char *fmt, ...)
+{
+    (void)fmt;
+}
+
+#define pr_crit(fmt, ...) shim_printk(fmt, ##__VA_ARGS__)
+#define pr_err(fmt, ...) shim_printk(fmt, ##__VA_ARGS__)
+#define pr_warn(fmt, ...) shim_printk(fmt, ##__VA_ARGS__)
+#define pr_notice(fmt, ...) shim_printk(fmt, ##__VA_ARGS__)
+#define pr_info(fmt, ...) shim_printk(fmt, ##__VA_ARGS__)
+#define pr_debug(fmt, ...) shim_printk(fmt, ##__VA_ARGS__)
+
+static inline u64
+div_u64(u64 dividend, u32 divisor)
+{
+    return dividend / divisor;
+}
+
+static inline u64
+div64_u64(u64 dividend, u64 divisor)
+{
+    return dividend / divisor;
+}
+
+struct hlist_node {
+    struct hlist_node *next, **pprev;
+};
+
+struct hlist_head {
+    struct hlist_node *first;
+};
+
+/* Atomics */
+
+typedef struct {
+    long counter;
+} atomic_long_t;
+
+#define ATOMIC_LONG_INIT(value) { (value) }
+#define atomic_long_read(v) ((v)->counter)
+#define atomic_long_set(v, value) ((v)->counter = (value))
+#define atomic_long_add(value, v) ((v)->counter += (value))
+#define atomic_long_sub(value, v) ((v)->counter -= (value))
+#define atomic_long_inc(v) ((v)->counter++)
+
+typedef struct {
+    int counter;
+} atomic_t;
+
+#define atomic_read(v) ((v)->counter)
+#define atomic_inc(v) ((v)->counter++)
+#define atomic_dec(v) ((v)->counter--)
+
+/* Locking */
+
+typedef struct { int dummy; } rwlock_t;
+typedef struct { int dummy; } spinlock_t;
+struct mutex { int dummy; };
+
+#define __RW_LOCK_UNLOCKED(name) { 0 }
+#define __SPIN_LOCK_UNLOCKED(name) { 0 }
+#define DEFINE_RWLOCK(name) rwlock_t name = __RW_LOCK_UNLOCKED(name)
+#define DEFINE_SPINLOCK(name) spinlock_t name = __SPIN_LOCK_UNLOCKED(name)
+#define DEFINE_MUTEX(name) struct mutex name = { 0 }
+
+#define rwlock_init(lock) ((void)(lock))
+#define spin_lock_init(lock) ((void)(lock))
+#define mutex_init(lock) ((void)(lock))
+#define read_lock(lock) ((void)(lock))
+#define read_unlock(lock) ((void)(lock))
+#define write_lock(lock) ((void)(lock))
+#define write_unlock(lock) ((void)(lock))
+#define spin_lock(lock) ((void)(lock))
+#define spin_unlock(lock) ((void)(lock))
+#define mutex_lock(lock) ((void)(lock))
+#define mutex_unlock(lock) ((void)(lock))
+#define lockdep_assert_held(lock) ((void)(lock))
+#define lockdep_assert_held_write(lock) ((void)(lock))
+#define lockdep_is_held(lock) 1
+
+struct rw_semaphore { int dummy; };
+
+#define DECLARE_RWSEM(name) struct rw_semaphore name = { 0 }
+#define init_rwsem(sem) ((void)(sem))
+#define down_read(sem) ((void)(sem))
+#define up_read(sem) ((void)(sem))
+#define down_write(sem) ((void)(sem))
+#define up_write(sem) ((void)(sem))
+
+/* RCU */
+
+struct rcu_head {
+    void *next;
+};
+
+#define rcu_read_lock() do { } while (0)
+#define rcu_read_unlock() do { } while (0)
+#define rcu_dereference(p) (p)
+#define rcu_dereference_protected(p, c) (p)
+#define rcu_assign_pointer(p, v) ((p) = (v))
+#define rcu_access_pointer(p) (p)
+#define rcu_replace_pointer(p, v, c) ({ typeof(p) __old = (p); (p) = (v); __old; })
+#define RCU_INIT_POINTER(p, v) ((p) = (v))
+#define synchronize_rcu() do { } while (0)
+#define kfree_rcu(ptr, field) free(ptr)
+
+/* Slab */
+
+struct kmem_cache {
+    size_t size;
+};
+
+#define kmalloc(size, gfp) malloc(size)
+#define kzalloc(size, gfp) calloc(1, size)
+#define kvmalloc(size, gfp) malloc(size)
+#define kvmalloc_node(size, gfp, node) malloc(size)
+#define kvzalloc(size, gfp) calloc(1, size)
+#define kmalloc_array(n, size, gfp) calloc(n, size)
+#define kfree(ptr) free((void *)(ptr))
+#define kvfree(ptr) free((void *)(ptr))
+#define kvmalloc_array(n, size, gfp) calloc(n, size)
+
+#define struct_size(ptr, member, count) \
+    (sizeof(*(ptr)) + sizeof(*(ptr)->member) * (count))
+
+static inline struct kmem_cache *
+shim_cache_create(size_t size)
+{
+    struct kmem_cache *cache;
+
+    cache = malloc(sizeof(*cache));
+    if (cache)
+        cache->size = size;
+
+    return cache;
+}
+
+#define KMEM_CACHE(type, flags) shim_cache_create(sizeof(struct type))
+#define kmem_cache_create(name, size, align, flags, ctor) \
+    shim_cache_create(size)
+#define kmem_cache_alloc(cache, gfp) malloc((cache)->size)
+#define kmem_cache_zalloc(cache, gfp) calloc(1, (cache)->size)
+#define kmem_cache_free(cache, ptr) free(ptr)
+#define kmem_cache_destroy(cache) free(cache)
+
+/* Bit operations and sorting */
+
+#define ffz(word) ((unsigned long)__builtin_ctzl(~(unsigned long)(word)))
+
+static inline void
+sort(void *base, size_t num, size_t size,
+     int (*cmp)(const void *, const void *),
+     void (*swap)(void *, void *, int))
+{
+    qsort(base, num, size, cmp);
+}
+
+/* Strings */
+
+static inline const char *
+kbasename(const char *path)
+{
+    const char *tail = strrchr(path, '/');
+    return tail ? tail + 1 : path;
+}
+
+static inline ssize_t
+strscpy(char *dest, const char *src, size_t count)
+{
+    size_t length;
+
+    length = strnlen(src, count);
+    if (length == count) {
+        if (count) {
+            memcpy(dest, src, count - 1);
+            dest[count - 1] = '\0';
+        }
+        return -E2BIG;
+    }
+
+    memcpy(dest, src, length + 1);
+    return length;
+}
+
+/* Credentials and tasks */
+
+typedef struct {
+    uid_t val;
+} kuid_t;
+
+#define KUIDT_INIT(value) (kuid_t){ value }
+#define INVALID_UID KUIDT_INIT(-1)
+
+static inline uid_t
+__kuid_val(kuid_t uid)
+{
+    return uid.val;
+}
+
+static inline bool
+uid_eq(kuid_t left, kuid_t right)
+{
+    return __kuid_val(left) == __kuid_val(right);
+}
+
+static inline bool
+uid_lt(kuid_t left, kuid_t right)
+{
+    return __kuid_val(left) < __kuid_val(right);
+}
+
+static inline bool
+uid_gt(kuid_t left, kuid_t right)
+{
+    return __kuid_val(left) > __kuid_val(right);
+}
+
+static inline bool
+uid_valid(kuid_t uid)
+{
+    return !uid_eq(uid, INVALID_UID);
+}
+
+struct mnt_namespace;
+
+struct nsproxy {
+    struct mnt_namespace *mnt_ns;
+};
+
+struct cred {
+    kuid_t uid;
+};
+
+struct task_struct {
+    struct nsproxy *nsproxy;
+    const struct cred *cred;
+};
+
+extern struct task_struct shim_current;
+
+#define current (&shim_current)
+#define current_cred() (current->cred)
+#define current_uid() (current_cred()->uid)
+
+#endif /* _SHIM_LINUX_KERNEL_H_ */
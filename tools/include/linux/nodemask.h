@@ -0,0 +1,14 @@
+/* SPDX-License-Identifier: GPL-2.0-or-later */
+/*
+ * Copyright(c) 2024 John Sanpe <sanpeqf@gmail.com>
+ */
+
+#ifndef _SHIM_LINUX_NODEMASK_H_
+#define _SHIM_LINUX_NODEMASK_H_
+
+#include <linux/topology.h>
+
+#define num_online_nodes() nr_node_ids
+#define node_online(node) ((node) < nr_node_ids)
+
+#endif /* _SHIM_LINUX_NODEMASK_H_ */
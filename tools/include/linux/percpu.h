@@ -0,0 +1,19 @@
+/* SPDX-License-Identifier: GPL-2.0-or-later */
+/*
+ * Copyright(c) 2024 John Sanpe <sanpeqf@gmail.com>
+ */
+
+#ifndef _SHIM_LINUX_PERCPU_H_
+#define _SHIM_LINUX_PERCPU_H_
+
+#include <linux/kernel.h>
+
+/* A single cpu, per cpu data is one plain copy. */
+#define alloc_percpu(type) ((type *)calloc(1, sizeof(type)))
+#define free_percpu(ptr) free(ptr)
+#define per_cpu_ptr(ptr, cpu) ((void)(cpu), (ptr))
+#define this_cpu_inc(pcp) ((pcp)++)
+#define this_cpu_write(pcp, val) ((pcp) = (val))
+#define for_each_possible_cpu(cpu) for ((cpu) = 0; (cpu) < 1; (cpu)++)
+
+#endif /* _SHIM_LINUX_PERCPU_H_ */
@@ -0,0 +1,32 @@
+/* SPDX-License-Identifier: GPL-2.0-or-later */
+/*
+ * Copyright(c) 2024 John Sanpe <sanpeqf@gmail.com>
+ */
+
+#ifndef _SHIM_LINUX_PROC_NS_H_
+#define _SHIM_LINUX_PROC_NS_H_
+
+#include <linux/kernel.h>
+
+struct ns_common;
+
+struct proc_ns_operations {
+    void (*put)(struct ns_common *ns);
+};
+
+struct ns_common {
+    const struct proc_ns_operations *ops;
+};
+
+/* Nothing is pinned in userspace, references only need to balance. */
+extern int shim_ns_refs;
+extern struct ns_common shim_ns;
+
+static inline struct ns_common *
+shim_ns_get(void)
+{
+    ++shim_ns_refs;
+    return &shim_ns;
+}
+
+#endif /* _SHIM_LINUX_PROC_NS_H_ */
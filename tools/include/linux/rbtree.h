@@ -0,0 +1,72 @@
+/* SPDX-License-Identifier: GPL-2.0-or-later */
+/*
+ * Copyright(c) 2024 John Sanpe <sanpeqf@gmail.com>
+ */
+
+#ifndef _SHIM_LINUX_RBTREE_H_
+#define _SHIM_LINUX_RBTREE_H_
+
+#include <linux/kernel.h>
+
+struct rb_node {
+    struct rb_node *rb_parent;
+    struct rb_node *rb_right;
+    struct rb_node *rb_left;
+    bool rb_black;
+};
+
+struct rb_root {
+    struct rb_node *rb_node;
+};
+
+#define RB_ROOT (struct rb_root) { NULL, }
+#define RB_EMPTY_ROOT(root) (READ_ONCE((root)->rb_node) == NULL)
+#define rb_entry(ptr, type, member) container_of(ptr, type, member)
+#define rb_parent(node) ((node)->rb_parent)
+
+#define rb_entry_safe(ptr, type, member) ({ \
+    typeof(ptr) ____ptr = (ptr); \
+    ____ptr ? rb_entry(____ptr, type, member) : NULL; \
+})
+
+static inline void
+rb_link_node(struct rb_node *node, struct rb_node *parent,
+             struct rb_node **rb_link)
+{
+    node->rb_parent = parent;
+    node->rb_black = false;
+    node->rb_left = node->rb_right = NULL;
+    *rb_link = node;
+}
+
+extern void
+rb_insert_color(struct rb_node *node, struct rb_root *root);
+
+extern void
+rb_erase(struct rb_node *node, struct rb_root *root);
+
+extern struct rb_node *
+rb_first(const struct rb_root *root);
+
+extern struct rb_node *
+rb_last(const struct rb_root *root);
+
+extern struct rb_node *
+rb_next(const struct rb_node *node);
+
+extern struct rb_node *
+rb_prev(const struct rb_node *node);
+
+extern struct rb_node *
+rb_first_postorder(const struct rb_root *root);
+
+extern struct rb_node *
+rb_next_postorder(const struct rb_node *node);
+
+#define rbtree_postorder_for_each_entry_safe(pos, n, root, field) \
+    for (pos = rb_entry_safe(rb_first_postorder(root), typeof(*pos), field); \
+         pos && ({ n = rb_entry_safe(rb_next_postorder(&pos->field), \
+            typeof(*pos), field); 1; }); \
+         pos = n)
+
+#endif /* _SHIM_LINUX_RBTREE_H_ */
@@ -0,0 +1,18 @@
+/* SPDX-License-Identifier: GPL-2.0-or-later */
+/*
+ * Copyright(c) 2024 John Sanpe <sanpeqf@gmail.com>
+ */
+
+#ifndef _SHIM_LINUX_TOPOLOGY_H_
+#define _SHIM_LINUX_TOPOLOGY_H_
+
+#include <linux/kernel.h>
+
+/* Two nodes, so sealed tables are replicated, the bench picks the node. */
+#define nr_node_ids 2
+
+extern int shim_numa_node;
+
+#define numa_node_id() (shim_numa_node)
+
+#endif /* _SHIM_LINUX_TOPOLOGY_H_ */
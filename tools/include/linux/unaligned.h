@@ -0,0 +1,17 @@
+/* SPDX-License-Identifier: GPL-2.0-or-later */
+/*
+ * Copyright(c) 2024 John Sanpe <sanpeqf@gmail.com>
+ */
+
+#ifndef _SHIM_LINUX_UNALIGNED_H_
+#define _SHIM_LINUX_UNALIGNED_H_
+
+#include <linux/kernel.h>
+
+#define get_unaligned(ptr) ({                   \
+    typeof(*(ptr) + 0) __val;                   \
+    memcpy(&__val, (ptr), sizeof(__val));       \
+    __val;                                      \
+})
+
+#endif /* _SHIM_LINUX_UNALIGNED_H_ */
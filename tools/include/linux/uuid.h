@@ -0,0 +1,24 @@
+/* SPDX-License-Identifier: GPL-2.0-or-later */
+/*
+ * Copyright(c) 2024 John Sanpe <sanpeqf@gmail.com>
+ */
+
+#ifndef _SHIM_LINUX_UUID_H_
+#define _SHIM_LINUX_UUID_H_
+
+#include <linux/kernel.h>
+
+#define UUID_SIZE 16
+#define UUID_STRING_LEN 36
+
+typedef struct {
+    __u8 b[UUID_SIZE];
+} uuid_t;
+
+extern bool
+uuid_is_valid(const char *uuid);
+
+extern int
+uuid_parse(const char *uuid, uuid_t *u);
+
+#endif /* _SHIM_LINUX_UUID_H_ */
@@ -0,0 +1,73 @@
+/* SPDX-License-Identifier: GPL-2.0-or-later */
+/*
+ * Copyright(c) 2024 John Sanpe <sanpeqf@gmail.com>
+ */
+
+#ifndef _SHIM_LINUX_XARRAY_H_
+#define _SHIM_LINUX_XARRAY_H_
+
+#include <linux/kernel.h>
+
+/*
+ * Sorted array standing in for the xarray. Only single-index entries
+ * are supported, so CONFIG_XARRAY_MULTI stays undefined.
+ */
+struct xa_slot {
+    unsigned long index;
+    void *entry;
+};
+
+struct xarray {
+    struct xa_slot *slots;
+    unsigned long count;
+    unsigned long size;
+};
+
+typedef unsigned int xa_mark_t;
+
+#define XA_PRESENT 0U
+#define DEFINE_XARRAY(name) struct xarray name = { NULL, 0, 0 }
+
+extern void *
+xa_load(struct xarray *xa, unsigned long index);
+
+extern void *
+xa_store(struct xarray *xa, unsigned long index, void *entry, gfp_t gfp);
+
+extern void *
+xa_erase(struct xarray *xa, unsigned long index);
+
+extern void *
+xa_find(struct xarray *xa, unsigned long *index,
+        unsigned long max, xa_mark_t filter);
+
+extern void *
+xa_find_after(struct xarray *xa, unsigned long *index,
+              unsigned long max, xa_mark_t filter);
+
+extern void
+xa_destroy(struct xarray *xa);
+
+static inline bool
+xa_empty(const struct xarray *xa)
+{
+    return !xa->count;
+}
+
+static inline bool
+xa_is_err(const void *entry)
+{
+    return IS_ERR(entry);
+}
+
+static inline int
+xa_err(void *entry)
+{
+    return xa_is_err(entry) ? PTR_ERR(entry) : 0;
+}
+
+#define xa_for_each(xa, index, entry) \
+    for (index = 0, entry = xa_find(xa, &index, ULONG_MAX, XA_PRESENT); \
+         entry; entry = xa_find_after(xa, &index, ULONG_MAX, XA_PRESENT))
+
+#endif /* _SHIM_LINUX_XARRAY_H_ */
@@ -0,0 +1,328 @@
+/* SPDX-License-Identifier: GPL-2.0-or-later */
+/*
+ * Copyright(c) 2024 John Sanpe <sanpeqf@gmail.com>
+ */
+
+/*
+ * Plain red-black tree for the userspace shim. It implements the same
+ * interface as lib/rbtree.c without the augmented callbacks.
+ */
+
+#include <linux/rbtree.h>
+
+static inline bool
+is_black(const struct rb_node *node)
+{
+    return !node || node->rb_black;
+}
+
+static void
+change_child(struct rb_root *root, struct rb_node *parent,
+             struct rb_node *old, struct rb_node *new)
+{
+    if (!parent)
+        root->rb_node = new;
+    else if (parent->rb_left == old)
+        parent->rb_left = new;
+    else
+        parent->rb_right = new;
+}
+
+static void
+rotate_left(struct rb_root *root, struct rb_node *node)
+{
+    struct rb_node *right = node->rb_right;
+
+    node->rb_right = right->rb_left;
+    if (right->rb_left)
+        right->rb_left->rb_parent = node;
+
+    right->rb_parent = node->rb_parent;
+    change_child(root, node->rb_parent, node, right);
+
+    right->rb_left = node;
+    node->rb_parent = right;
+}
+
+static void
+rotate_right(struct rb_root *root, struct rb_node *node)
+{
+    struct rb_node *left = node->rb_left;
+
+    node->rb_left = left->rb_right;
+    if (left->rb_right)
+        left->rb_right->rb_parent = node;
+
+    left->rb_parent = node->rb_parent;
+    change_child(root, node->rb_parent, node, left);
+
+    left->rb_right = node;
+    node->rb_parent = left;
+}
+
+void
+rb_insert_color(struct rb_node *node, struct rb_root *root)
+{
+    struct rb_node *parent, *gparent, *uncle;
+
+    while ((parent = node->rb_parent) && !parent->rb_black) {
+        gparent = parent->rb_parent;
+
+        if (parent == gparent->rb_left) {
+            uncle = gparent->rb_right;
+            if (!is_black(uncle)) {
+                parent->rb_black = uncle->rb_black = true;
+                gparent->rb_black = false;
+                node = gparent;
+                continue;
+            }
+
+            if (node == parent->rb_right) {
+                rotate_left(root, parent);
+                node = parent;
+                parent = node->rb_parent;
+            }
+
+            parent->rb_black = true;
+            gparent->rb_black = false;
+            rotate_right(root, gparent);
+        } else {
+            uncle = gparent->rb_left;
+            if (!is_black(uncle)) {
+                parent->rb_black = uncle->rb_black = true;
+                gparent->rb_black = false;
+                node = gparent;
+                continue;
+            }
+
+            if (node == parent->rb_left) {
+                rotate_right(root, parent);
+                node = parent;
+                parent = node->rb_parent;
+            }
+
+            parent->rb_black = true;
+            gparent->rb_black = false;
+            rotate_left(root, gparent);
+        }
+    }
+
+    root->rb_node->rb_black = true;
+}
+
+static void
+erase_fixup(struct rb_root *root, struct rb_node *node,
+            struct rb_node *parent)
+{
+    struct rb_node *sibling;
+
+    while (node != root->rb_node && is_black(node)) {
+        if (node == parent->rb_left) {
+            sibling = parent->rb_right;
+            if (!is_black(sibling)) {
+                sibling->rb_black = true;
+                parent->rb_black = false;
+                rotate_left(root, parent);
+                sibling = parent->rb_right;
+            }
+
+            if (is_black(sibling->rb_left) && is_black(sibling->rb_right)) {
+                sibling->rb_black = false;
+                node = parent;
+                parent = node->rb_parent;
+                continue;
+            }
+
+            if (is_black(sibling->rb_right)) {
+                sibling->rb_left->rb_black = true;
+                sibling->rb_black = false;
+                rotate_right(root, sibling);
+                sibling = parent->rb_right;
+            }
+
+            sibling->rb_black = parent->rb_black;
+            parent->rb_black = true;
+            sibling->rb_right->rb_black = true;
+            rotate_left(root, parent);
+        } else {
+            sibling = parent->rb_left;
+            if (!is_black(sibling)) {
+                sibling->rb_black = true;
+                parent->rb_black = false;
+                rotate_right(root, parent);
+                sibling = parent->rb_left;
+            }
+
+            if (is_black(sibling->rb_left) && is_black(sibling->rb_right)) {
+                sibling->rb_black = false;
+                node = parent;
+                parent = node->rb_parent;
+                continue;
+            }
+
+            if (is_black(sibling->rb_left)) {
+                sibling->rb_right->rb_black = true;
+                sibling->rb_black = false;
+                rotate_left(root, sibling);
+                sibling = parent->rb_left;
+            }
+
+            sibling->rb_black = parent->rb_black;
+            parent->rb_black = true;
+            sibling->rb_left->rb_black = true;
+            rotate_right(root, parent);
+        }
+
+        node = root->rb_node;
+        break;
+    }
+
+    if (node)
+        node->rb_black = true;
+}
+
+void
+rb_erase(struct rb_node *node, struct rb_root *root)
+{
+    struct rb_node *child, *parent, *successor;
+    bool black;
+
+    if (node->rb_left && node->rb_right) {
+        successor = node->rb_right;
+        while (successor->rb_left)
+            successor = successor->rb_left;
+
+        child = successor->rb_right;
+        black = successor->rb_black;
+
+        if (successor->rb_parent == node) {
+            parent = successor;
+        } else {
+            parent = successor->rb_parent;
+            parent->rb_left = child;
+            if (child)
+                child->rb_parent = parent;
+
+            successor->rb_right = node->rb_right;
+            node->rb_right->rb_parent = successor;
+        }
+
+        successor->rb_left = node->rb_left;
+        node->rb_left->rb_parent = successor;
+        successor->rb_parent = node->rb_parent;
+        successor->rb_black = node->rb_black;
+        change_child(root, node->rb_parent, node, successor);
+    } else {
+        child = node->rb_left ? node->rb_left : node->rb_right;
+        parent = node->rb_parent;
+        black = node->rb_black;
+
+        if (child)
+            child->rb_parent = parent;
+        change_child(root, parent, node, child);
+    }
+
+    if (black)
+        erase_fixup(root, child, parent);
+}
+
+struct rb_node *
+rb_first(const struct rb_root *root)
+{
+    struct rb_node *node = root->rb_node;
+
+    if (!node)
+        return NULL;
+
+    while (node->rb_left)
+        node = node->rb_left;
+
+    return node;
+}
+
+struct rb_node *
+rb_last(const struct rb_root *root)
+{
+    struct rb_node *node = root->rb_node;
+
+    if (!node)
+        return NULL;
+
+    while (node->rb_right)
+        node = node->rb_right;
+
+    return node;
+}
+
+struct rb_node *
+rb_next(const struct rb_node *node)
+{
+    struct rb_node *parent;
+
+    if (node->rb_right) {
+        node = node->rb_right;
+        while (node->rb_left)
+            node = node->rb_left;
+        return (struct rb_node *)node;
+    }
+
+    while ((parent = node->rb_parent) && node == parent->rb_right)
+        node = parent;
+
+    return parent;
+}
+
+struct rb_node *
+rb_prev(const struct rb_node *node)
+{
+    struct rb_node *parent;
+
+    if (node->rb_left) {
+        node = node->rb_left;
+        while (node->rb_right)
+            node = node->rb_right;
+        return (struct rb_node *)node;
+    }
+
+    while ((parent = node->rb_parent) && node == parent->rb_left)
+        node = parent;
+
+    return parent;
+}
+
+static struct rb_node *
+left_deepest(const struct rb_node *node)
+{
+    for (;;) {
+        if (node->rb_left)
+            node = node->rb_left;
+        else if (node->rb_right)
+            node = node->rb_right;
+        else
+            return (struct rb_node *)node;
+    }
+}
+
+struct rb_node *
+rb_first_postorder(const struct rb_root *root)
+{
+    if (!root->rb_node)
+        return NULL;
+
+    return left_deepest(root->rb_node);
+}
+
+struct rb_node *
+rb_next_postorder(const struct rb_node *node)
+{
+    const struct rb_node *parent;
+
+    if (!node)
+        return NULL;
+
+    parent = node->rb_parent;
+    if (parent && node == parent->rb_left && parent->rb_right)
+        return left_deepest(parent->rb_right);
+
+    return (struct rb_node *)parent;
+}
@@ -0,0 +1,208 @@
+/* SPDX-License-Identifier: GPL-2.0-or-later */
+/*
+ * Copyright(c) 2024 John Sanpe <sanpeqf@gmail.com>
+ */
+
+#include <linux/kernel.h>
+#include <linux/xarray.h>
+#include <linux/uuid.h>
+#include <linux/jiffies.h>
+#include <linux/topology.h>
+#include <linux/proc_ns.h>
+#include <ctype.h>
+
+unsigned long jiffies;
+int shim_numa_node;
+int shim_ns_refs;
+
+static void
+shim_ns_put(struct ns_common *ns)
+{
+    --shim_ns_refs;
+}
+
+static const struct proc_ns_operations shim_ns_ops = {
+    .put = shim_ns_put,
+};
+
+struct ns_common shim_ns = {
+    .ops = &shim_ns_ops,
+};
+
+static const struct cred shim_cred;
+struct task_struct shim_current = {
+    .cred = &shim_cred,
+};
+
+static unsigned long
+xa_lower_bound(const struct xarray *xa, unsigned long index)
+{
+    unsigned long left, right, mid;
+
+    left = 0;
+    right = xa->count;
+
+    while (left < right) {
+        mid = left + (right - left) / 2;
+        if (xa->slots[mid].index < index)
+            left = mid + 1;
+        else
+            right = mid;
+    }
+
+    return left;
+}
+
+void *
+xa_load(struct xarray *xa, unsigned long index)
+{
+    unsigned long pos;
+
+    pos = xa_lower_bound(xa, index);
+    if (pos < xa->count && xa->slots[pos].index == index)
+        return xa->slots[pos].entry;
+
+    return NULL;
+}
+
+void *
+xa_erase(struct xarray *xa, unsigned long index)
+{
+    unsigned long pos;
+    void *entry;
+
+    pos = xa_lower_bound(xa, index);
+    if (pos >= xa->count || xa->slots[pos].index != index)
+        return NULL;
+
+    entry = xa->slots[pos].entry;
+    memmove(&xa->slots[pos], &xa->slots[pos + 1],
+            (xa->count - pos - 1) * sizeof(*xa->slots));
+    xa->count--;
+
+    return entry;
+}
+
+void *
+xa_store(struct xarray *xa, unsigned long index, void *entry, gfp_t gfp)
+{
+    struct xa_slot *slots;
+    unsigned long pos;
+    void *old;
+
+    if (!entry)
+        return xa_erase(xa, index);
+
+    pos = xa_lower_bound(xa, index);
+    if (pos < xa->count && xa->slots[pos].index == index) {
+        old = xa->slots[pos].entry;
+        xa->slots[pos].entry = entry;
+        return old;
+    }
+
+    if (xa->count == xa->size) {
+        slots = realloc(xa->slots, (xa->size * 2 + 16) * sizeof(*slots));
+        if (!slots)
+            return ERR_PTR(-ENOMEM);
+        xa->slots = slots;
+        xa->size = xa->size * 2 + 16;
+    }
+
+    memmove(&xa->slots[pos + 1], &xa->slots[pos],
+            (xa->count - pos) * sizeof(*xa->slots));
+    xa->slots[pos].index = index;
+    xa->slots[pos].entry = entry;
+    xa->count++;
+
+    return NULL;
+}
+
+void *
+xa_find(struct xarray *xa, unsigned long *index,
+        unsigned long max, xa_mark_t filter)
+{
+    unsigned long pos;
+
+    pos = xa_lower_bound(xa, *index);
+    if (pos >= xa->count || xa->slots[pos].index > max)
+        return NULL;
+
+    *index = xa->slots[pos].index;
+    return xa->slots[pos].entry;
+}
+
+void *
+xa_find_after(struct xarray *xa, unsigned long *index,
+              unsigned long max, xa_mark_t filter)
+{
+    unsigned long next;
+    void *entry;
+
+    if (*index == ULONG_MAX)
+        return NULL;
+
+    next = *index + 1;
+    entry = xa_find(xa, &next, max, filter);
+    if (entry)
+        *index = next;
+
+    return entry;
+}
+
+void
+xa_destroy(struct xarray *xa)
+{
+    free(xa->slots);
+    xa->slots = NULL;
+    xa->count = xa->size = 0;
+}
+
+static const u8 uuid_index[16] = {
+    0, 2, 4, 6, 9, 11, 14, 16, 19, 21, 24, 26, 28, 30, 32, 34
+};
+
+bool
+uuid_is_valid(const char *uuid)
+{
+    unsigned int index;
+
+    for (index = 0; index < UUID_STRING_LEN; index++) {
+        if (index == 8 || index == 13 || index == 18 || index == 23) {
+            if (uuid[index] != '-')
+                return false;
+        } else if (!isxdigit((unsigned char)uuid[index])) {
+            return false;
+        }
+    }
+
+    return true;
+}
+
+static int
+hex_to_bin(unsigned char ch)
+{
+    if (ch >= '0' && ch <= '9')
+        return ch - '0';
+
+    ch = tolower(ch);
+    if (ch >= 'a' && ch <= 'f')
+        return ch - 'a' + 10;
+
+    return -1;
+}
+
+int
+uuid_parse(const char *uuid, uuid_t *u)
+{
+    unsigned int index;
+
+    if (!uuid_is_valid(uuid))
+        return -EINVAL;
+
+    for (index = 0; index < UUID_SIZE; index++) {
+        u->b[index] = hex_to_bin(uuid[uuid_index[index]]) << 4 |
+                      hex_to_bin(uuid[uuid_index[index] + 1]);
+    }
+
+    return 0;
+}
@@ -0,0 +1,269 @@
+/* SPDX-License-Identifier: GPL-2.0-or-later */
+/*
+ * Copyright(c) 2024 John Sanpe <sanpeqf@gmail.com>
+ */
+
+/*
+ * Replay a trace read from /proc/lksu/trace against the userspace
+ * build of the tables and report lookup throughput per hook type.
+ * The rules file has one rule per line:
+ *
+ *   /path                  global hidden file
+ *   uid FIRST-LAST /path   hidden for a uid range
+ *
+ * usage: replay-trace [-r rules] trace [iterations]
+ */
+
+#include "../src/lksu.h"
+#include "../src/tables.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+struct replay_event {
+    enum lksu_trace_hook hook;
+    bool verdict;
+    uid_t uid;
+    u32 latency;
+    char *name;
+};
+
+struct replay_stat {
+    unsigned long count;
+    unsigned long mismatch;
+    u64 recorded;
+    u64 replayed;
+};
+
+static const char *
+hook_names[] = {
+    [LKSU_TRACE_FILE] = "file",
+    [LKSU_TRACE_PATH] = "path",
+    [LKSU_TRACE_INODE] = "inode",
+    [LKSU_TRACE_DIRENT] = "dirent",
+};
+
+static struct replay_event *events;
+static size_t event_count;
+static struct replay_stat stats[LKSU_TRACE_HOOK_NR];
+static struct nsproxy replay_nsproxy;
+static struct cred replay_cred;
+
+static u64
+replay_now(void)
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (u64)ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+static int
+load_rules(const char *path)
+{
+    unsigned int first, last;
+    char line[PATH_MAX + 64];
+    char name[PATH_MAX];
+    unsigned int lineno;
+    FILE *file;
+    int retval;
+
+    file = fopen(path, "r");
+    if (!file) {
+        perror(path);
+        return -1;
+    }
+
+    lineno = 0;
+    while (fgets(line, sizeof(line), file)) {
+        lineno++;
+        line[strcspn(line, "\n")] = '\0';
+
+        if (!*line || *line == '#')
+            continue;
+
+        if (sscanf(line, "uid %u-%u %4095s", &first, &last, name) == 3)
+            retval = lksu_table_uidfile_add(KUIDT_INIT(first), KUIDT_INIT(last), name);
+        else
+            retval = lksu_table_gfile_add(line);
+
+        if (retval && retval != -EALREADY) {
+            fprintf(stderr, "%s:%u: %s\n", path, lineno, strerror(-retval));
+            fclose(file);
+            return -1;
+        }
+    }
+
+    fclose(file);
+    return 0;
+}
+
+static int
+load_trace(const char *path)
+{
+    struct lksu_trace_event event;
+    struct replay_event *node;
+    size_t length, size;
+    FILE *file;
+
+    file = fopen(path, "rb");
+    if (!file) {
+        perror(path);
+        return -1;
+    }
+
+    size = 0;
+    while (fread(&event, sizeof(event), 1, file) == 1) {
+        if (event.size < sizeof(event) || event.hook >= LKSU_TRACE_HOOK_NR)
+            goto corrupt;
+
+        if (event_count == size) {
+            size = size * 2 + 1024;
+            events = realloc(events, size * sizeof(*events));
+            if (!events)
+                goto nomem;
+        }
+
+        length = event.size - sizeof(event);
+        node = &events[event_count];
+        node->name = malloc(length + 1);
+        if (!node->name)
+            goto nomem;
+
+        if (fread(node->name, 1, length, file) != length)
+            goto corrupt;
+
+        node->name[length] = '\0';
+        node->hook = event.hook;
+        node->verdict = event.verdict;
+        node->uid = event.uid;
+        node->latency = event.latency;
+        event_count++;
+    }
+
+    fclose(file);
+    return 0;
+
+corrupt:
+    fprintf(stderr, "%s: corrupt record %zu\n", path, event_count);
+    fclose(file);
+    return -1;
+
+nomem:
+    fprintf(stderr, "%s: out of memory\n", path);
+    fclose(file);
+    return -1;
+}
+
+static bool
+replay_one(const struct replay_event *event)
+{
+    replay_cred.uid = KUIDT_INIT(event->uid);
+
+    if (event->hook == LKSU_TRACE_DIRENT)
+        return lksu_table_dirent_check(event->name);
+
+    return lksu_table_file_check(event->name);
+}
+
+static void
+replay(unsigned long iters)
+{
+    const struct replay_event *event;
+    struct replay_stat *stat;
+    unsigned long count;
+    size_t index;
+    u64 start, total;
+    bool verdict;
+
+    /* Per hook costs, includes the clock overhead of each lookup. */
+    for (index = 0; index < event_count; ++index) {
+        event = &events[index];
+        stat = &stats[event->hook];
+        stat->count++;
+        stat->recorded += event->latency;
+
+        start = replay_now();
+        verdict = replay_one(event);
+        stat->replayed += replay_now() - start;
+
+        if (verdict != event->verdict)
+            stat->mismatch++;
+    }
+
+    start = replay_now();
+    for (count = 0; count < iters; ++count) {
+        for (index = 0; index < event_count; ++index) {
+            verdict = replay_one(&events[index]);
+            OPTIMIZER_HIDE_VAR(verdict);
+        }
+    }
+    total = replay_now() - start;
+
+    for (index = 0; index < LKSU_TRACE_HOOK_NR; ++index) {
+        stat = &stats[index];
+        if (!stat->count)
+            continue;
+
+        printf("%-8s events=%-9lu recorded=%8.1f ns replayed=%8.1f ns mismatch=%lu\n",
+               hook_names[index], stat->count,
+               (double)stat->recorded / stat->count,
+               (double)stat->replayed / stat->count,
+               stat->mismatch);
+    }
+
+    if (total)
+        printf("total    events=%-9zu %.0f lookups/s\n", event_count,
+               (double)event_count * iters * 1000000000.0 / total);
+}
+
+int
+main(int argc, char *argv[])
+{
+    const char *rules;
+    unsigned long iters;
+    int opt;
+
+    rules = NULL;
+    while ((opt = getopt(argc, argv, "r:")) != -1) {
+        switch (opt) {
+            case 'r':
+                rules = optarg;
+                break;
+
+            default:
+                goto usage;
+        }
+    }
+
+    if (optind >= argc)
+        goto usage;
+
+    iters = optind + 1 < argc ? strtoul(argv[optind + 1], NULL, 0) : 10;
+    if (!iters)
+        goto usage;
+
+    current->nsproxy = &replay_nsproxy;
+    current->cred = &replay_cred;
+
+    if (lksu_tables_init())
+        return 1;
+
+    if (rules && load_rules(rules))
+        return 1;
+
+    if (load_trace(argv[optind]))
+        return 1;
+
+    replay(iters);
+    lksu_tables_exit();
+
+    return 0;
+
+usage:
+    fprintf(stderr, "usage: %s [-r rules] trace [iterations]\n", argv[0]);
+    return 1;
+}